@@ -0,0 +1,158 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+
+#include <diy/serialization.hpp>
+
+#include "../opts.h"
+
+// Measures the throughput of serializing a vector of particles field by field:
+//  - "virtual":    Serialization<VirtualParticle> takes a BinaryBuffer&, so every field is a virtual call
+//                  that checks the capacity of the buffer (this is how all serialization went before
+//                  MemoryBuffer became final);
+//  - "static":     Serialization<StaticParticle> is templated on the buffer, so saving it into a
+//                  MemoryBuffer inlines MemoryBuffer::save_binary();
+//  - "unchecked":  the space for all the particles is reserved up front and written with UncheckedWriter.
+
+struct Particle
+{
+  float     x[3];
+  float     v[3];
+  int       id;
+};
+
+struct VirtualParticle: Particle      {};
+struct StaticParticle:  Particle      {};
+
+namespace diy
+{
+  template<>
+  struct Serialization<VirtualParticle>
+  {
+    static void save(BinaryBuffer& bb, const VirtualParticle& p)
+    {
+      for (int i = 0; i < 3; ++i) diy::save(bb, p.x[i]);
+      for (int i = 0; i < 3; ++i) diy::save(bb, p.v[i]);
+      diy::save(bb, p.id);
+    }
+    static void load(BinaryBuffer& bb, VirtualParticle& p)
+    {
+      for (int i = 0; i < 3; ++i) diy::load(bb, p.x[i]);
+      for (int i = 0; i < 3; ++i) diy::load(bb, p.v[i]);
+      diy::load(bb, p.id);
+    }
+  };
+
+  template<>
+  struct Serialization<StaticParticle>
+  {
+    template<class Buffer>
+    static void save(Buffer& bb, const StaticParticle& p)
+    {
+      for (int i = 0; i < 3; ++i) diy::save(bb, p.x[i]);
+      for (int i = 0; i < 3; ++i) diy::save(bb, p.v[i]);
+      diy::save(bb, p.id);
+    }
+    template<class Buffer>
+    static void load(Buffer& bb, StaticParticle& p)
+    {
+      for (int i = 0; i < 3; ++i) diy::load(bb, p.x[i]);
+      for (int i = 0; i < 3; ++i) diy::load(bb, p.v[i]);
+      diy::load(bb, p.id);
+    }
+  };
+}
+
+const size_t    particle_bytes = 7*4;
+
+template<class P>
+void    fill(std::vector<P>& particles)
+{
+  for (size_t i = 0; i < particles.size(); ++i)
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      particles[i].x[j] = i + j;
+      particles[i].v[j] = i - j;
+    }
+    particles[i].id = i;
+  }
+}
+
+template<class F>
+double  seconds(int reps, F f)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int r = 0; r < reps; ++r)
+    f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void    report(const char* name, double t, size_t n, int reps)
+{
+  std::cout << name << ": " << t / (double(n) * reps) * 1e9 << " ns/particle, "
+            << double(n) * reps * particle_bytes / t / (1 << 20) << " MB/s" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  size_t    n    = 1 << 20;
+  int       reps = 10;
+
+  using namespace opts;
+  Options ops(argc, argv);
+  ops
+      >> Option('n', "particles", n,    "number of particles")
+      >> Option('r', "reps",      reps, "number of repetitions")
+      ;
+  if (ops >> Present('h', "help", "show help"))
+  {
+    std::cout << ops;
+    return 1;
+  }
+
+  std::vector<VirtualParticle>  vparticles(n);
+  std::vector<StaticParticle>   sparticles(n);
+  fill(vparticles);
+  fill(sparticles);
+
+  diy::MemoryBuffer bb;
+  bb.reserve(n * particle_bytes + sizeof(size_t));
+
+  double t = seconds(reps, [&]() { bb.clear(); diy::BinaryBuffer& b = bb; diy::save(b, vparticles); });
+  report("virtual save", t, n, reps);
+
+  t = seconds(reps, [&]() { bb.reset(); diy::BinaryBuffer& b = bb; diy::load(b, vparticles); });
+  report("virtual load", t, n, reps);
+
+  t = seconds(reps, [&]() { bb.clear(); diy::save(bb, sparticles); });
+  report("static save", t, n, reps);
+
+  t = seconds(reps, [&]() { bb.reset(); diy::load(bb, sparticles); });
+  report("static load", t, n, reps);
+
+  t = seconds(reps, [&]()
+  {
+    bb.clear();
+    diy::UncheckedWriter out(bb, sizeof(size_t) + n * particle_bytes);
+    out.save(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      out.save(sparticles[i].x, 3);
+      out.save(sparticles[i].v, 3);
+      out.save(sparticles[i].id);
+    }
+  });
+  report("unchecked save", t, n, reps);
+
+  // check the round trip
+  std::vector<StaticParticle> result;
+  bb.reset();
+  diy::load(bb, result);
+  for (size_t i = 0; i < n; ++i)
+    if (result[i].id != sparticles[i].id || result[i].x[2] != sparticles[i].x[2] || result[i].v[1] != sparticles[i].v[1])
+    {
+      std::cout << "Mismatch at particle " << i << std::endl;
+      return 1;
+    }
+}
@@ -50,11 +50,9 @@ struct SampleSort
             for (int i = 0; i < k_in; ++i)
             {
                 if (skip_self && rp.in_link().target(i).gid == rp.gid()) continue;
-                MemoryBuffer& in = rp.incoming(rp.in_link().target(i).gid);
-                size_t sz = in.size() / sizeof(T);
-                T* bg = (T*) &in.buffer[0];
-                std::copy(bg, bg + sz, &v[end]);
-                end += sz;
+                Span<T> in = rp.incoming_span<T>(rp.in_link().target(i).gid);
+                std::copy(in.begin(), in.end(), v.begin() + end);
+                end += in.size();
             }
         } else
         {
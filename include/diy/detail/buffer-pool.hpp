@@ -0,0 +1,128 @@
+#ifndef DIY_DETAIL_BUFFER_POOL_HPP
+#define DIY_DETAIL_BUFFER_POOL_HPP
+
+#include <vector>
+#include <utility>
+#include <limits>
+
+#include "flat-map.hpp"
+#include "../serialization.hpp"
+
+namespace diy
+{
+namespace detail
+{
+  // Keeps the storage of the queues that Master is done with, so that the next round can reuse it
+  // instead of allocating (and growing) it again. Buffers are binned by size class, the floor of
+  // the log of their capacity, and by the rank they were exchanged with: handing a buffer back to
+  // the same peer lets MPI reuse its memory registration for that transfer.
+  class BufferPool
+  {
+    public:
+      typedef       MemoryBuffer::Buffer            Buffer;
+
+    public:
+      //! an empty buffer from `resource` with capacity for at least `size` bytes, preferably one last
+      //! exchanged with `rank`; if the pool has none, a new one is allocated
+      inline Buffer         acquire(int rank, size_t size, MemoryResource* resource = MemoryResource::new_delete());
+      //! take over the storage of `buffer`; `rank` is the peer it was exchanged with, or -1
+      inline void           release(int rank, Buffer& buffer);
+      //! drop the buffers that went unused since the previous call
+      inline void           trim();
+
+      size_t                bytes() const                       { return bytes_; }      //!< total capacity of the buffers in the pool
+
+    private:
+      struct Entry
+      {
+        Buffer              buffer;
+        unsigned            generation;
+      };
+      typedef       std::pair<int,int>              Key;        // (size class, rank)
+      typedef       std::vector<Entry>              Entries;
+
+      // floor and ceiling of log2
+      static int            floor_log(size_t x)                 { int c = -1; while (x) { x >>= 1; ++c; } return c; }
+      static int            ceil_log(size_t x)                  { return x <= 1 ? 0 : floor_log(x - 1) + 1; }
+
+      inline bool           take(Entries& entries, Buffer& buffer);      // into buffer, if entries has one from its resource
+
+    private:
+      FlatMap<Key, Entries> free_;
+      unsigned              generation_ = 0;
+      size_t                bytes_      = 0;
+  };
+}
+}
+
+diy::detail::BufferPool::Buffer
+diy::detail::BufferPool::
+acquire(int rank, size_t size, MemoryResource* resource)
+{
+  if (size == 0)
+    return Buffer(resource);
+
+  // every buffer in class c holds at least 2^c bytes; look for the requested peer first, then any other
+  int    c = ceil_log(size);
+  Buffer buffer(resource);
+  FlatMap<Key, Entries>::iterator it = free_.find(Key(c, rank));
+  if (it != free_.end() && take(it->second, buffer))
+    return buffer;
+
+  for (it = free_.lower_bound(Key(c, std::numeric_limits<int>::min())); it != free_.end() && it->first.first == c; ++it)
+    if (take(it->second, buffer))
+      return buffer;
+
+  // round up to the size class, so that the buffer comes back into the class it was requested from
+  buffer.reserve(size_t(1) << c);
+  return buffer;
+}
+
+void
+diy::detail::BufferPool::
+release(int rank, Buffer& buffer)
+{
+  if (buffer.capacity() == 0)
+    return;
+
+  Entries& entries = free_[Key(floor_log(buffer.capacity()), rank)];
+  entries.emplace_back();
+  entries.back().buffer.swap(buffer);
+  entries.back().buffer.clear();
+  entries.back().generation = generation_;
+  bytes_ += entries.back().buffer.capacity();
+}
+
+void
+diy::detail::BufferPool::
+trim()
+{
+  // the entries are stacks, so the ones released before the previous call are at the bottom
+  for (FlatMap<Key, Entries>::iterator it = free_.begin(); it != free_.end(); ++it)
+  {
+    Entries& entries = it->second;
+    size_t stale = 0;
+    while (stale < entries.size() && entries[stale].generation != generation_)
+      bytes_ -= entries[stale++].buffer.capacity();
+    entries.erase(entries.begin(), entries.begin() + stale);
+  }
+  ++generation_;
+}
+
+bool
+diy::detail::BufferPool::
+take(Entries& entries, Buffer& buffer)
+{
+  // the most recently released buffer from the same resource
+  for (size_t i = entries.size(); i-- > 0; )
+    if (entries[i].buffer.get_allocator().resource() == buffer.get_allocator().resource())
+    {
+      buffer.swap(entries[i].buffer);
+      entries.erase(entries.begin() + i);
+      bytes_ -= buffer.capacity();
+      return true;
+    }
+  return false;
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef DIY_DETAIL_FLAT_MAP_HPP
+#define DIY_DETAIL_FLAT_MAP_HPP
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+#include <cassert>
+#include <cstdint>
+
+namespace diy
+{
+namespace detail
+{
+  // A map stored as a vector of (key, value) pairs, sorted by key.
+  // Meant for the handful of queues a block exchanges with its neighbors:
+  // lookups are binary searches over contiguous memory, and clear() keeps
+  // the capacity for the next round. As with a vector, inserting or erasing
+  // invalidates the iterators and references to the elements.
+  template<class Key, class T, class Compare = std::less<Key>>
+  class FlatMap
+  {
+    public:
+      typedef       Key                                 key_type;
+      typedef       T                                   mapped_type;
+      typedef       std::pair<Key, T>                   value_type;
+      typedef       std::vector<value_type>             Container;
+      typedef       typename Container::iterator        iterator;
+      typedef       typename Container::const_iterator  const_iterator;
+
+    public:
+      iterator          begin()                         { return elements_.begin(); }
+      iterator          end()                           { return elements_.end(); }
+      const_iterator    begin() const                   { return elements_.begin(); }
+      const_iterator    end() const                     { return elements_.end(); }
+
+      size_t            size() const                    { return elements_.size(); }
+      bool              empty() const                   { return elements_.empty(); }
+      void              clear()                         { elements_.clear(); }
+      void              reserve(size_t n)               { elements_.reserve(n); }
+      void              swap(FlatMap& other)            { elements_.swap(other.elements_); }
+
+      iterator          lower_bound(const Key& k)       { return std::lower_bound(begin(), end(), k, KeyCompare()); }
+      const_iterator    lower_bound(const Key& k) const { return std::lower_bound(begin(), end(), k, KeyCompare()); }
+
+      iterator          find(const Key& k)              { iterator it = lower_bound(k); return (it == end() || Compare()(k, it->first)) ? end() : it; }
+      const_iterator    find(const Key& k) const        { const_iterator it = lower_bound(k); return (it == end() || Compare()(k, it->first)) ? end() : it; }
+      size_t            count(const Key& k) const       { return find(k) != end(); }
+
+      T&                operator[](const Key& k)
+      {
+        iterator it = lower_bound(k);
+        if (it == end() || Compare()(k, it->first))
+          it = elements_.insert(it, value_type(k, T()));
+        return it->second;
+      }
+
+      iterator          erase(iterator it)              { return elements_.erase(it); }
+      size_t            erase(const Key& k)             { iterator it = find(k); if (it == end()) return 0; erase(it); return 1; }
+
+    private:
+      struct KeyCompare
+      {
+        bool    operator()(const value_type& x, const Key& k) const     { return Compare()(x.first, k); }
+      };
+
+      Container         elements_;
+  };
+
+  // Maps non-negative integer keys (global block ids) to integer values
+  // (local block ids) in an open-addressing hash table with linear probing.
+  class IndexMap
+  {
+    public:
+                        IndexMap()                      { clear(); }
+
+      //! return the value associated with `key`, or -1 if there is none
+      int               find(int key) const
+      {
+        for (size_t j = slot(key); ; j = (j + 1) & mask_)
+        {
+          if (slots_[j].key == key)
+            return slots_[j].value;
+          if (slots_[j].key == empty)
+            return -1;
+        }
+      }
+
+      inline void       insert(int key, int value);     //!< insert `key`, or overwrite its value
+      inline void       erase(int key);
+      void              clear()                         { resize(8); size_ = 0; }
+      size_t            size() const                    { return size_; }
+
+    private:
+      static const int  empty = -1;
+
+      struct Slot
+      {
+        int     key   = empty;
+        int     value = -1;
+      };
+
+      // Fibonacci hashing (the top bits of key * 2^32/phi) spreads out the gids that an assigner deals with a fixed stride
+      size_t            slot(int key) const             { return static_cast<uint32_t>(static_cast<uint32_t>(key) * 2654435769u) >> shift_; }
+
+      void              resize(size_t n)                { slots_.assign(n, Slot()); mask_ = n - 1; shift_ = 32; while (n >>= 1) --shift_; }
+      inline void       grow();
+
+    private:
+      std::vector<Slot> slots_;
+      size_t            mask_;
+      int               shift_;
+      size_t            size_;
+  };
+}
+}
+
+void
+diy::detail::IndexMap::
+insert(int key, int value)
+{
+  assert(key >= 0);
+  if (2*(size_ + 1) > slots_.size())      // keep the load factor at most 1/2
+    grow();
+
+  size_t j = slot(key);
+  while (slots_[j].key != empty && slots_[j].key != key)
+    j = (j + 1) & mask_;
+
+  if (slots_[j].key == empty)
+    ++size_;
+  slots_[j].key   = key;
+  slots_[j].value = value;
+}
+
+void
+diy::detail::IndexMap::
+erase(int key)
+{
+  size_t j = slot(key);
+  while (slots_[j].key != key)
+  {
+    if (slots_[j].key == empty)
+      return;
+    j = (j + 1) & mask_;
+  }
+
+  // shift the following entries back to close the gap, instead of leaving a tombstone
+  size_t gap = j;
+  for (size_t k = (gap + 1) & mask_; slots_[k].key != empty; k = (k + 1) & mask_)
+  {
+    size_t home = slot(slots_[k].key);
+    if (((k - home) & mask_) >= ((k - gap) & mask_))     // the gap lies between home and k
+    {
+      slots_[gap] = slots_[k];
+      gap = k;
+    }
+  }
+  slots_[gap] = Slot();
+  --size_;
+}
+
+void
+diy::detail::IndexMap::
+grow()
+{
+  std::vector<Slot> old;
+  old.swap(slots_);
+  resize(2*old.size());
+  size_ = 0;
+
+  for (size_t j = 0; j < old.size(); ++j)
+    if (old[j].key != empty)
+      insert(old[j].key, old[j].value);
+}
+
+#endif
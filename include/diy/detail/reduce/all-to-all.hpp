@@ -82,8 +82,10 @@ namespace detail
           {
             std::pair<int, int> from_to;
             load(in, from_to);
-            load(in, all_srp.incoming(from_to.first));
-            all_srp.incoming(from_to.first).reset();
+            MemoryBuffer& from = all_srp.incoming(from_to.first);
+            load(in, from);
+            from.alignment = srp.master()->queue_alignment();     // the sender padded the nested queue with it
+            from.reset();
           }
         }
 
@@ -0,0 +1,108 @@
+#ifndef DIY_DETAIL_SCHEDULER_HPP
+#define DIY_DETAIL_SCHEDULER_HPP
+
+#include <vector>
+#include <deque>
+
+#include "../thread.hpp"
+
+namespace diy
+{
+namespace detail
+{
+  // Hands out local block indices to the threads of Master::execute()
+  struct BlockScheduler
+  {
+    virtual bool    next(int thread, int& i, bool& stolen)  =0;     // returns false once there is no more work for `thread`
+    virtual         ~BlockScheduler()                       {}
+  };
+
+  // All threads pull from a single shared index (the original scheme)
+  struct SharedIndexScheduler: public BlockScheduler
+  {
+                    SharedIndexScheduler(const std::deque<int>& blocks_):
+                        blocks(blocks_), idx(0)                     {}
+
+    bool            next(int, int& i, bool& stolen) override
+    {
+      stolen = false;
+      int cur = (*idx.access())++;
+      if ((size_t)cur >= blocks.size())
+        return false;
+      i = blocks[cur];
+      return true;
+    }
+
+    const std::deque<int>&  blocks;
+    critical_resource<int>  idx;
+  };
+
+  // Every thread owns a deque of blocks; it works from the front of its own
+  // deque, and once it runs dry, steals half of the remaining blocks from the
+  // back of another thread's deque.
+  struct WorkStealingScheduler: public BlockScheduler
+  {
+    struct Queue
+    {
+      mutex             m;              // rather than a spinlock, so that race detectors see it
+      std::deque<int>   blocks;
+    };
+
+                    WorkStealingScheduler(const std::deque<int>& blocks, int nthreads):
+                        queues(nthreads)
+    {
+      // deal the blocks round-robin, so that the loaded blocks, which come
+      // first, are spread evenly and sit at the front of every deque
+      for (size_t j = 0; j < blocks.size(); ++j)
+        queues[j % nthreads].blocks.push_back(blocks[j]);
+    }
+
+    bool            next(int thread, int& i, bool& stolen) override
+    {
+      stolen = false;
+      if (pop(thread, i))
+        return true;
+
+      int nthreads = queues.size();
+      std::vector<int> loot;
+      for (int k = 1; k < nthreads; ++k)
+      {
+        Queue& victim = queues[(thread + k) % nthreads];
+        {
+          lock_guard<mutex> lock(victim.m);
+          size_t n = victim.blocks.size();
+          if (n == 0)
+            continue;
+          size_t take = (n + 1) / 2;
+          loot.assign(victim.blocks.end() - take, victim.blocks.end());
+          victim.blocks.erase(victim.blocks.end() - take, victim.blocks.end());
+        }
+
+        Queue& own = queues[thread];
+        lock_guard<mutex> lock(own.m);
+        own.blocks.insert(own.blocks.end(), loot.begin() + 1, loot.end());
+        i = loot.front();
+        stolen = true;
+        return true;
+      }
+
+      return false;
+    }
+
+    bool            pop(int thread, int& i)
+    {
+      Queue& own = queues[thread];
+      lock_guard<mutex> lock(own.m);
+      if (own.blocks.empty())
+        return false;
+      i = own.blocks.front();
+      own.blocks.pop_front();
+      return true;
+    }
+
+    std::vector<Queue>      queues;
+  };
+}
+}
+
+#endif
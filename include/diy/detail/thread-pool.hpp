@@ -0,0 +1,204 @@
+#ifndef DIY_DETAIL_THREAD_POOL_HPP
+#define DIY_DETAIL_THREAD_POOL_HPP
+
+#include <vector>
+#include <functional>
+#include <exception>
+#include <chrono>
+
+#include "../thread.hpp"
+
+#ifndef DIY_NO_THREADS
+#include <condition_variable>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+#endif
+
+namespace diy
+{
+namespace detail
+{
+#ifndef DIY_NO_THREADS
+  // Persistent worker threads, started lazily and reused by every job.
+  // A job is run by the first n workers, each receiving its index.
+  class ThreadPool
+  {
+    public:
+      typedef       std::function<void(int)>        Job;
+
+    public:
+                    ThreadPool()                    {}
+                    ~ThreadPool()                   { stop(); }
+
+                    ThreadPool(const ThreadPool&)               = delete;
+      ThreadPool&   operator=(const ThreadPool&)                = delete;
+
+      //! pin worker i to cpus[i % cpus.size()]; an empty vector removes the pinning
+      void          set_affinity(const std::vector<int>& cpus)  { lock_guard<mutex> lock(m_); cpus_ = cpus; }
+
+      //! start job(0), ..., job(n-1) on n workers without waiting for them
+      inline void   submit(int n, const Job& job);
+      //! wait for the last submitted job to finish; rethrows the first exception it raised
+      inline void   wait();
+      //! wait at most `timeout` for the last submitted job to finish; returns whether it did (call wait() afterwards)
+      template<class Duration>
+      bool          wait_for(const Duration& timeout)
+      {
+        lock_guard<mutex> lock(m_);
+        return done_.wait_for(lock, timeout, [this]() { return remaining_ == 0; });
+      }
+      //! submit() and wait()
+      void          execute(int n, const Job& job)  { submit(n, job); wait(); }
+
+      size_t        size() const                    { return workers_.size(); }
+
+    private:
+      inline void   stop();
+      inline void   work(int i);
+      inline void   pin(int i, const void* original);
+
+    private:
+      std::vector<std::thread>  workers_;
+      mutex                     m_;
+      std::condition_variable   start_, done_;
+
+      Job                       job_;
+      int                       active_     = 0;        // number of workers participating in the current job
+      int                       remaining_  = 0;        // number of workers that haven't finished the current job
+      unsigned long             generation_ = 0;        // incremented with every job
+      bool                      stop_       = false;
+      std::exception_ptr        error_;
+
+      std::vector<int>          cpus_;
+  };
+#else
+  // Without threads, jobs run sequentially in the calling thread.
+  class ThreadPool
+  {
+    public:
+      typedef       std::function<void(int)>        Job;
+
+    public:
+      void          set_affinity(const std::vector<int>&)       {}
+      void          submit(int n, const Job& job)   { for (int i = 0; i < n; ++i) job(i); }
+      void          wait()                          {}
+      template<class Duration>
+      bool          wait_for(const Duration&)       { return true; }
+      void          execute(int n, const Job& job)  { submit(n, job); }
+      size_t        size() const                    { return 0; }
+  };
+#endif
+}
+}
+
+#ifndef DIY_NO_THREADS
+void
+diy::detail::ThreadPool::
+submit(int n, const Job& job)
+{
+  lock_guard<mutex> lock(m_);
+
+  while (workers_.size() < (size_t) n)
+    workers_.emplace_back(&ThreadPool::work, this, (int) workers_.size());
+
+  job_       = job;
+  active_    = n;
+  remaining_ = n;
+  error_     = std::exception_ptr();
+  ++generation_;
+  start_.notify_all();
+}
+
+void
+diy::detail::ThreadPool::
+wait()
+{
+  lock_guard<mutex> lock(m_);
+  done_.wait(lock, [this]() { return remaining_ == 0; });
+
+  job_ = Job();
+  if (error_)
+  {
+    std::exception_ptr e = error_;
+    error_ = std::exception_ptr();
+    std::rethrow_exception(e);
+  }
+}
+
+void
+diy::detail::ThreadPool::
+stop()
+{
+  {
+    lock_guard<mutex> lock(m_);
+    stop_ = true;
+    start_.notify_all();
+  }
+  for (size_t i = 0; i < workers_.size(); ++i)
+    workers_[i].join();
+  workers_.clear();
+}
+
+void
+diy::detail::ThreadPool::
+work(int i)
+{
+#if defined(__linux__)
+  cpu_set_t original;           // the affinity inherited from the thread that started the pool
+  pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &original);
+#else
+  int       original = 0;
+#endif
+
+  unsigned long seen = 0;
+  lock_guard<mutex> lock(m_);
+  while (true)
+  {
+    start_.wait(lock, [&]() { return stop_ || (generation_ != seen && i < active_); });
+    if (stop_)
+      return;
+    seen = generation_;
+
+    pin(i, &original);
+    lock.unlock();
+    try
+    {
+      job_(i);
+    } catch(...)
+    {
+      lock.lock();
+      if (!error_)
+        error_ = std::current_exception();
+      lock.unlock();
+    }
+    lock.lock();
+
+    if (--remaining_ == 0)
+      done_.notify_all();
+  }
+}
+
+// called with m_ locked
+void
+diy::detail::ThreadPool::
+pin(int i, const void* original)
+{
+#if defined(__linux__)
+  cpu_set_t set = *static_cast<const cpu_set_t*>(original);
+  if (!cpus_.empty())
+  {
+    CPU_ZERO(&set);
+    CPU_SET(cpus_[i % cpus_.size()], &set);
+  }
+
+  cpu_set_t current;
+  if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &current) == 0 && CPU_EQUAL(&set, &current))
+    return;
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &set);
+#endif
+}
+#endif
+
+#endif
@@ -135,12 +135,13 @@ namespace io
       // round-about way of gather vector of vectors of GidOffsetCount to avoid registering a new mpi datatype
       std::vector< std::vector<char> > gathered_offset_count_buffers;
       MemoryBuffer oc_buffer; diy::save(oc_buffer, offset_counts);
-      mpi::gather(comm, oc_buffer.buffer, gathered_offset_count_buffers, 0);
+      std::vector<char> oc(oc_buffer.buffer.begin(), oc_buffer.buffer.end());
+      mpi::gather(comm, oc, gathered_offset_count_buffers, 0);
 
       std::vector<GidOffsetCount>  all_offset_counts;
       for (unsigned i = 0; i < gathered_offset_count_buffers.size(); ++i)
       {
-        MemoryBuffer oc_buffer; oc_buffer.buffer.swap(gathered_offset_count_buffers[i]);
+        MemoryBuffer oc_buffer; oc_buffer.buffer.assign(gathered_offset_count_buffers[i].begin(), gathered_offset_count_buffers[i].end());
         std::vector<GidOffsetCount> offset_counts;
         diy::load(oc_buffer, offset_counts);
         for (unsigned j = 0; j < offset_counts.size(); ++j)
@@ -167,7 +168,8 @@ namespace io
     } else
     {
       MemoryBuffer oc_buffer; diy::save(oc_buffer, offset_counts);
-      mpi::gather(comm, oc_buffer.buffer, 0);
+      std::vector<char> oc(oc_buffer.buffer.begin(), oc_buffer.buffer.end());
+      mpi::gather(comm, oc, 0);
     }
   }
 
@@ -3,10 +3,13 @@
 
 #include <vector>
 #include <map>
+#include <limits>
 #include <list>
 #include <deque>
 #include <algorithm>
 #include <functional>
+#include <chrono>
+#include <memory>
 
 #include "link.hpp"
 #include "collection.hpp"
@@ -20,6 +23,10 @@
 #include "thread.hpp"
 
 #include "detail/block_traits.hpp"
+#include "detail/buffer-pool.hpp"
+#include "detail/flat-map.hpp"
+#include "detail/scheduler.hpp"
+#include "detail/thread-pool.hpp"
 
 #include "log.hpp"
 #include "stats.hpp"
@@ -92,29 +99,67 @@ namespace diy
         int round;
       };
 
-      struct InFlightSend
+      // Every message starts out on tags::header. A queue of at most eager_size() bytes travels in
+      // the same message, in front of its header; a larger one follows on its own payload tag.
+      struct MessageHeader
       {
-        std::shared_ptr<MemoryBuffer> message;
-        mpi::request                  request;
-
-        // for debug purposes:
         MessageInfo info;
+        size_t      size;               // of the queue
+        int         tag;                // tags::queue or tags::aggregate
+        int         seq;                // per-destination sequence number, picks the payload tag
       };
 
       struct InFlightRecv
       {
-        MemoryBuffer message;
-        MessageInfo info{ -1, -1, -1 };
+        MemoryBuffer    message;
+        MessageHeader   header;
+        int             source = -1;
+        int             pieces = 0;     // outstanding pieces of the payload
+      };
+
+      // What an outstanding request is for
+      struct InFlight
+      {
+        int                             tag;        // tags::queue (a send), tags::header (a header slot), or tags::payload
+        int                             proc;       // the destination of a send
+        std::shared_ptr<MemoryBuffer>   send;       // keeps the message alive until it's sent
+        std::shared_ptr<InFlightRecv>   recv;
       };
 
       struct Collective;
-      struct tags       { enum { queue, piece }; };
+      struct tags       { enum { queue, aggregate, header, payload }; };     // the payloads use the tags payload, ..., payload + payload_tags() - 1
+
+      static size_t     eager_size()                    { return 16384; }
+      static int        payload_tags()                  { return 16384; }      // MPI guarantees tags up to 32767
+      static int        max_header_slots()              { return 64; }
+#ifndef DIY_NO_LARGE_DATATYPES
+      static size_t     max_piece_size()                { return static_cast<size_t>(-1); }     // a larger payload goes as one element of a derived datatype
+#else
+      static size_t     max_piece_size()                { return std::numeric_limits<int>::max(); }  // the largest count MPI can handle
+#endif
+
+      //! How execute() distributes blocks among the threads
+      enum class Schedule
+      {
+        shared,                 //!< threads pull blocks, loaded ones first, from a single shared index
+        work_stealing           //!< every thread has its own deque of blocks and steals half of another thread's deque when it runs out
+      };
 
-      typedef           std::list<InFlightSend>             InFlightSendsList;
-      typedef           std::map<int, InFlightRecv>         InFlightRecvsMap;
-      typedef           std::list<int>                      ToSendList;         // [gid]
+      //! Per-thread timings of the last execute()
+      struct ThreadStats
+      {
+        double          busy    = 0;    //!< seconds spent loading, unloading, and running blocks
+        double          idle    = 0;    //!< seconds spent looking for work or waiting for the other threads to finish
+        size_t          blocks  = 0;    //!< number of blocks processed
+        size_t          steals  = 0;    //!< number of successful steals
+      };
+      typedef           std::vector<ThreadStats>            ThreadStatsVector;
+
+      typedef           std::vector<mpi::request>           Requests;
+      typedef           std::vector<InFlight>               InFlights;
+      typedef           std::list<int>                      ToSendList;         // [lid]
       typedef           std::list<Collective>               CollectivesList;
-      typedef           std::map<int, CollectivesList>      CollectivesMap;     // gid          -> [collectives]
+      typedef           std::vector<CollectivesList>        CollectivesMap;     // lid          -> [collectives]
 
 
       struct QueueRecord
@@ -124,24 +169,35 @@ namespace diy
         int             external;
       };
 
-      typedef           std::map<int,     QueueRecord>      InQueueRecords;     //  gid         -> (size, external)
-      typedef           std::map<int,     MemoryBuffer>     IncomingQueues;     //  gid         -> queue
-      typedef           std::map<BlockID, MemoryBuffer>     OutgoingQueues;     // (gid, proc)  -> queue
-      typedef           std::map<BlockID, QueueRecord>      OutQueueRecords;    // (gid, proc)  -> (size, external)
+      // A block exchanges queues with a handful of neighbors, so the per-block records are sorted
+      // vectors, and the tables of the per-block maps are indexed by the local id. The queues
+      // themselves stay in node-based maps: the references that Proxy::incoming() and
+      // Proxy::outgoing() hand out have to survive the creation of the other queues.
+      typedef           detail::FlatMap<int,     QueueRecord>   InQueueRecords;     //  gid         -> (size, external)
+      typedef           std::map<int,            MemoryBuffer>  IncomingQueues;     //  gid         -> queue
+      typedef           std::map<BlockID,        MemoryBuffer>  OutgoingQueues;     // (gid, proc)  -> queue
+      typedef           detail::FlatMap<BlockID, QueueRecord>   OutQueueRecords;    // (gid, proc)  -> (size, external)
+      typedef           detail::FlatMap<BlockID, size_t>        OutQueueSizes;      // (gid, proc)  -> size
       struct IncomingQueuesRecords
       {
+        void            clear()                                 { records.clear(); queues.clear(); }
+
         InQueueRecords  records;
         IncomingQueues  queues;
       };
       struct OutgoingQueuesRecord
       {
-                        OutgoingQueuesRecord(int e = -1): external(e)       {}
+                        OutgoingQueuesRecord(int e = -1): external(e), posted(false)    {}
+        void            clear()                                 { external = -1; posted = false; external_local.clear(); queues.clear(); }   // keeps the capacity and the sizes
+
         int             external;
+        bool            posted;         // remote queues already sent (see set_overlap())
         OutQueueRecords external_local;
         OutgoingQueues  queues;
+        OutQueueSizes   sizes;          // of the queues sent so far, to presize the next ones (see outgoing_queue())
       };
-      typedef           std::map<int,     IncomingQueuesRecords>    IncomingQueuesMap;  //  gid         -> {  gid       -> queue }
-      typedef           std::map<int,     OutgoingQueuesRecord>     OutgoingQueuesMap;  //  gid         -> { (gid,proc) -> queue }
+      typedef           std::vector<IncomingQueuesRecords>  IncomingQueuesMap;  //  lid         -> {  gid       -> queue }
+      typedef           std::vector<OutgoingQueuesRecord>   OutgoingQueuesMap;  //  lid         -> { (gid,proc) -> queue }
 
       struct IncomingRound
       {
@@ -150,6 +206,15 @@ namespace diy
       };
       typedef std::map<int, IncomingRound> IncomingRoundMap;
 
+      struct PostedQueue
+      {
+        int             from;
+        BlockID         to;
+        MemoryBuffer    queue;
+      };
+      typedef           std::vector<PostedQueue>            PostedQueues;
+      typedef           std::map<int, PostedQueues>         AggregatedQueues;   // proc         -> [queues]
+
 
     public:
      /**
@@ -177,11 +242,22 @@ namespace diy
                       storage_(storage),
                       // Communicator functionality
                       comm_(comm),
+                      inflight_sends_(0),
+                      header_slots_(0),
+                      target_header_slots_(0),
                       expected_(0),
                       exchange_round_(-1),
-                      immediate_(true)
+                      immediate_(true),
+                      overlap_(false),
+                      posting_(false),
+                      aggregate_(false),
+                      blocking_(false),
+                      resource_(MemoryResource::new_delete()),
+                      alignment_(0),
+                      queue_resource_(resource_),
+                      schedule_(Schedule::shared)
                                                         {}
-                    ~Master()                           { set_immediate(true); clear(); delete queue_policy_; }
+                    ~Master()                           { set_immediate(true); clear(); cancel_requests(); delete queue_policy_; }
       inline void   clear();
       inline void   destroy(int i)                      { if (blocks_.own()) blocks_.destroy(i); }
 
@@ -218,9 +294,9 @@ namespace diy
       //! return gid of the `i`-th block
       int           gid(int i) const                    { return gids_[i]; }
       //! return the local id of the local block with global id gid, or -1 if not local
-      int           lid(int gid) const                  { return local(gid) ?  lids_.find(gid)->second : -1; }
+      int           lid(int gid) const                  { return lids_.find(gid); }
       //! whether the block with global id gid is local
-      bool          local(int gid) const                { return lids_.find(gid) != lids_.end(); }
+      bool          local(int gid) const                { return lids_.find(gid) != -1; }
 
       //! exchange the queues between all the blocks (collective operation)
       inline void   exchange();
@@ -239,6 +315,15 @@ namespace diy
       int           in_memory() const                   { return *blocks_.in_memory().const_access(); }
 
       void          set_threads(int threads)            { threads_ = threads; }
+      //! pin the i-th worker thread to cpus[i % cpus.size()]; an empty vector (the default) leaves the threads unpinned
+      void          set_thread_affinity(const std::vector<int>& cpus)   { pool_.set_affinity(cpus); }
+
+      Schedule      schedule() const                    { return schedule_; }
+      //! choose how execute() hands out blocks to the threads
+      void          set_schedule(Schedule s)            { schedule_ = s; }
+      //! per-thread busy/idle time of the last execute()
+      const ThreadStatsVector&
+                    thread_stats() const                { return thread_stats_; }
 
       CreateBlock   creator() const                     { return blocks_.creator(); }
       DestroyBlock  destroyer() const                   { return blocks_.destroyer(); }
@@ -261,22 +346,58 @@ namespace diy
       bool          immediate() const                   { return immediate_; }
       void          set_immediate(bool i)               { if (i && !immediate_) execute(); immediate_ = i; }
 
+      bool          overlap() const                     { return overlap_; }
+      //! When the callbacks are executed by exchange() (i.e., after set_immediate(false)),
+      //! send each block's outgoing queues as soon as its callbacks finish and receive the
+      //! incoming queues while the remaining blocks are being processed.
+      //! With more than one thread, the callbacks run on the worker threads, while the thread
+      //! that called exchange() makes all the MPI calls, so MPI has to be initialized with at least
+      //! `MPI_THREAD_FUNNELED` (or `MPI_THREAD_SERIALIZED`, if that thread isn't the main one).
+      //! With one thread, the callbacks run in the calling thread, in between the sends.
+      void          set_overlap(bool o)                 { overlap_ = o; }
+
+      bool          aggregate() const                   { return aggregate_; }
+      //! Pack all the queues bound for the same process into a single message. Cuts the number
+      //! of messages per round to the number of neighboring processes, at the cost of keeping
+      //! all of the round's outgoing queues in memory until they are sent.
+      void          set_aggregate(bool a)               { aggregate_ = a; }
+
+      bool          blocking() const                    { return blocking_; }
+      //! Wait in MPI_Waitsome for the messages to arrive in flush(), instead of polling
+      //! for them (which keeps a core busy).
+      void          set_blocking(bool b)                { blocking_ = b; }
+
+      MemoryResource*   memory_resource() const         { return resource_; }
+      //! Allocate the queues from `r` (e.g., an ArenaResource, for the many small queues of a round,
+      //! a HugePageResource, or an mpi::alloc_mem_resource), which has to outlive them.
+      //! By default, they come from `operator new`. With more than one thread, the workers allocate
+      //! the queues, so `r` has to be thread-safe (an mpi::alloc_mem_resource needs MPI_THREAD_MULTIPLE).
+      void              set_memory_resource(MemoryResource* r)  { resource_ = r; update_queue_resource(); }
+
+      size_t            queue_alignment() const         { return alignment_; }
+      //! Frame the queues so that the arrays in them (enqueued as an array or a std::vector of a type
+      //! with default serialization) start at a multiple of `a` bytes, e.g. 64 for SIMD, or of the
+      //! type's alignment, if larger; the receivers can then use them in place (see Proxy::dequeue_view()).
+      //! The storage of the queues is allocated at (at least) `a`-byte boundaries, which makes the
+      //! offsets aligned in memory too. 0, the default, packs the arrays. Has to be the same on all processes.
+      void              set_queue_alignment(size_t a)   { alignment_ = a; update_queue_resource(); }
+
     public:
       // Communicator functionality
-      IncomingQueues&   incoming(int gid)               { return incoming_[exchange_round_].map[gid].queues; }
-      OutgoingQueues&   outgoing(int gid)               { return outgoing_[gid].queues; }
-      CollectivesList&  collectives(int gid)            { return collectives_[gid]; }
+      IncomingQueues&   incoming(int gid)               { return entry(incoming_[exchange_round_].map, lid(gid)).queues; }
+      OutgoingQueues&   outgoing(int gid)               { return entry(outgoing_, lid(gid)).queues; }
+      CollectivesList&  collectives(int gid)            { return entry(collectives_, lid(gid)); }
       size_t            incoming_count(int gid) const
       {
         IncomingRoundMap::const_iterator round_it = incoming_.find(exchange_round_);
         if (round_it == incoming_.end())
           return 0;
-        IncomingQueuesMap::const_iterator queue_it = round_it->second.map.find(gid);
-        if (queue_it == round_it->second.map.end())
+        size_t l = lid(gid);
+        if (l >= round_it->second.map.size())
           return 0;
-        return queue_it->second.queues.size();
+        return round_it->second.map[l].queues.size();
       }
-      size_t            outgoing_count(int gid) const   { OutgoingQueuesMap::const_iterator it = outgoing_.find(gid); if (it == outgoing_.end()) return 0; return it->second.queues.size(); }
+      size_t            outgoing_count(int gid) const   { size_t l = lid(gid); if (l >= outgoing_.size()) return 0; return outgoing_[l].queues.size(); }
 
       void              set_expected(int expected)      { expected_ = expected; }
       void              add_expected(int i)             { expected_ += i; }
@@ -290,9 +411,35 @@ namespace diy
     private:
       // Communicator functionality
       inline void       comm_exchange(ToSendList& to_send, int out_queues_limit);     // possibly called in between block computations
-      inline bool       nudge();
-
-      void              cancel_requests();              // TODO
+      inline void       send_queue(int from, int to, int proc, MemoryBuffer& queue, int round, int tag = tags::queue);
+      inline void       send_aggregated(int round);
+      inline void       post_send(int proc, int tag, std::shared_ptr<MemoryBuffer> message, const void* address, size_t count);
+      inline void       post_recv(int proc, int tag, std::shared_ptr<InFlightRecv> recv, void* address, size_t count);
+      inline void       post_header_slots();
+      inline void       cancel_header_slots();
+      inline void       receive_header(std::shared_ptr<InFlightRecv> recv, const mpi::status& status);
+      inline void       place_message(InFlightRecv& recv);
+      inline void       place_incoming(int from, int to, int round, MemoryBuffer& queue);
+      inline bool       nudge(bool wait = false);       // test (or wait for) the outstanding requests; returns whether any completed
+      inline void       compact_requests();
+
+      // opportunistic communication (see set_overlap())
+      inline void       post_outgoing(int i);           // called by the threads processing the blocks
+      inline void       send_posted();                  // called by the thread that called execute()
+
+      inline void       cancel_requests();
+
+      // recycling of the queue storage across rounds
+      inline MemoryBuffer&
+                        outgoing_queue(OutgoingQueues& queues, const OutQueueSizes& sizes, const BlockID& to);    // a new queue gets the capacity the last one to `to` needed
+      inline void       recycle(IncomingQueuesRecords& in);
+      inline void       update_queue_resource();        // after a change of resource_ or alignment_
+
+      // the lid-indexed tables grow to hold every block on first access, so that the
+      // references to their elements (e.g., in a Proxy) stay valid until add()
+      template<class Table>
+      typename Table::value_type&
+                        entry(Table& table, int lid)    { assert(lid >= 0 && lid < (int) size()); if ((size_t) lid >= table.size()) table.resize(size()); return table[lid]; }
 
       // debug
       inline void       show_incoming_records() const;
@@ -301,7 +448,7 @@ namespace diy
       std::vector<Link*>    links_;
       Collection            blocks_;
       std::vector<int>      gids_;
-      std::map<int, int>    lids_;
+      detail::IndexMap      lids_;
 
       QueuePolicy*          queue_policy_;
 
@@ -309,19 +456,46 @@ namespace diy
       int                   threads_;
       ExternalStorage*      storage_;
 
+      // declared ahead of the queues, so that it outlives their storage
+      std::vector<std::unique_ptr<AlignedResource>>     aligned_resources_;
+
     private:
       // Communicator
       mpi::communicator     comm_;
       IncomingRoundMap      incoming_;
       OutgoingQueuesMap     outgoing_;
-      InFlightSendsList     inflight_sends_;
-      InFlightRecvsMap      inflight_recvs_;
+      Requests              requests_;          // outstanding sends and receives, completed with MPI_Testsome/MPI_Waitsome
+      InFlights             inflight_;          // what requests_[j] is for
+      std::vector<int>          completed_;     // scratch space for nudge()
+      std::vector<mpi::status>  statuses_;
+      size_t                inflight_sends_;
+      int                   header_slots_;      // number of pre-posted receives on tags::header
+      int                   target_header_slots_;   // computed from the links by post_header_slots()
+      detail::FlatMap<int, int> sequence_;      // proc -> seq of the next message sent to it
       CollectivesMap        collectives_;
       int                   expected_;
       int                   exchange_round_;
       bool                  immediate_;
       Commands              commands_;
 
+      bool                  overlap_;
+      bool                  posting_;           // the callbacks being executed are followed by flush()
+      critical_resource<PostedQueues, mutex>    posted_;   // std::mutex, rather than a spinlock, so that race detectors see it
+
+      bool                  aggregate_;
+      AggregatedQueues      aggregated_;        // remote queues waiting to be packed, by process
+
+      bool                  blocking_;
+
+      critical_resource<detail::BufferPool, mutex>  buffers_;  // storage of the queues that were sent or consumed
+      MemoryResource*                       resource_;  // where new storage for the queues comes from
+      size_t                                alignment_; // of the arrays in the queues (see set_queue_alignment())
+      MemoryResource*                       queue_resource_;    // resource_, or an AlignedResource over it, if alignment_ calls for one
+
+      Schedule              schedule_;
+      ThreadStatsVector     thread_stats_;
+      detail::ThreadPool    pool_;              // started lazily, by the first multi-threaded execute()
+
     private:
       fast_mutex            add_mutex_;
 
@@ -383,14 +557,20 @@ namespace diy
 // --- ProcessBlock ---
 struct diy::Master::ProcessBlock
 {
+  typedef std::chrono::steady_clock     Clock;
+
           ProcessBlock(Master&                    master_,
-                       const std::deque<int>&     blocks_,
+                       int                        id_,
                        int                        local_limit_,
-                       critical_resource<int>&    idx_):
+                       detail::BlockScheduler&    scheduler_,
+                       ThreadStats&               stats_,
+                       bool                       send_posted_ = false):
               master(master_),
-              blocks(blocks_),
+              id(id_),
               local_limit(local_limit_),
-              idx(idx_)
+              scheduler(scheduler_),
+              stats(stats_),
+              send_posted(send_posted_)
           {}
 
   void    process()
@@ -400,12 +580,17 @@ struct diy::Master::ProcessBlock
     std::vector<int>      local;
     do
     {
-      int cur = (*idx.access())++;
-
-      if ((size_t)cur >= blocks.size())
+      int  i;
+      bool stolen;
+      if (!scheduler.next(id, i, stolen))
           return;
 
-      int i = blocks[cur];
+      Clock::time_point start = Clock::now();
+
+      ++stats.blocks;
+      if (stolen)
+          ++stats.steals;
+
       if (master.block(i))
       {
           if (local.size() == (size_t)local_limit)
@@ -425,21 +610,25 @@ struct diy::Master::ProcessBlock
           }
       }
 
-      IncomingQueuesMap &current_incoming = master.incoming_[master.exchange_round_].map;
+      IncomingQueuesRecords& current_incoming = master.entry(master.incoming_[master.exchange_round_].map, i);
       if (skip_block)
       {
           if (master.block(i) == 0)
               master.load_queues(i);      // even though we are skipping the block, the queues might be necessary
+          else
+              master.load_incoming(master.gid(i));  // queues that arrived ahead of their round might have been unloaded
 
           for (size_t cmd = 0; cmd < master.commands_.size(); ++cmd)
           {
               master.commands_[cmd]->execute(0, master.proxy(i));  // 0 signals that we are skipping the block (even if it's loaded)
 
               // no longer need them, so get rid of them, rather than risk reloading
-              current_incoming[master.gid(i)].queues.clear();
-              current_incoming[master.gid(i)].records.clear();
+              master.recycle(current_incoming);
           }
 
+          if (master.posting_)
+              post(i);
+
           if (master.block(i) == 0)
               master.unload_queues(i);    // even though we are skipping the block, the queues might be necessary
       }
@@ -452,29 +641,38 @@ struct diy::Master::ProcessBlock
 
               master.load(i);
               local.push_back(i);
-          }
+          } else
+              master.load_incoming(master.gid(i));  // queues that arrived ahead of their round might have been unloaded
 
           for (size_t cmd = 0; cmd < master.commands_.size(); ++cmd)
           {
               master.commands_[cmd]->execute(master.block(i), master.proxy(i));
 
               // no longer need them, so get rid of them
-              current_incoming[master.gid(i)].queues.clear();
-              current_incoming[master.gid(i)].records.clear();
+              master.recycle(current_incoming);
           }
+
+          if (master.posting_)
+              post(i);
       }
-    } while(true);
 
-    // TODO: invoke opportunistic communication
-    //       don't forget to adjust Master::exchange()
+      stats.busy += std::chrono::duration<double>(Clock::now() - start).count();
+    } while(true);
   }
 
-  static void run(void* bf)                   { static_cast<ProcessBlock*>(bf)->process(); }
+  void    post(int i)
+  {
+      master.post_outgoing(i);
+      if (send_posted)            // processing the blocks in the thread that makes the MPI calls
+          master.send_posted();
+  }
 
   Master&                 master;
-  const std::deque<int>&  blocks;
+  int                     id;
   int                     local_limit;
-  critical_resource<int>& idx;
+  detail::BlockScheduler& scheduler;
+  ThreadStats&            stats;
+  bool                    send_posted;
 };
 // --------------------
 
@@ -489,6 +687,11 @@ clear()
   gids_.clear();
   lids_.clear();
   expected_ = 0;
+
+  // the queue tables are indexed by the local ids, which are about to be reused
+  outgoing_.clear();
+  incoming_.clear();
+  collectives_.clear();
 }
 
 void
@@ -513,22 +716,24 @@ void
 diy::Master::
 unload_incoming(int gid)
 {
-  for (IncomingRoundMap::iterator round_itr = incoming_.begin(); round_itr != incoming_.end(); ++round_itr)
+  // only the current round: the queues of the future rounds went through the queue policy when
+  // they were received, and they may still be arriving (see set_overlap())
+  IncomingRoundMap::iterator round_itr = incoming_.find(exchange_round_);
+  if (round_itr == incoming_.end())
+    return;
+
+  size_t l = lid(gid);
+  if (l >= round_itr->second.map.size())
+    return;
+
+  IncomingQueuesRecords& in_qrs = round_itr->second.map[l];
+  for (InQueueRecords::iterator it = in_qrs.records.begin(); it != in_qrs.records.end(); ++it)
   {
-    IncomingQueuesMap::iterator qmap_itr = round_itr->second.map.find(gid);
-    if (qmap_itr == round_itr->second.map.end())
+    QueueRecord& qr = it->second;
+    if (queue_policy_->unload_incoming(*this, it->first, gid, qr.size))
     {
-      continue;
-    }
-    IncomingQueuesRecords& in_qrs = qmap_itr->second;
-    for (InQueueRecords::iterator it = in_qrs.records.begin(); it != in_qrs.records.end(); ++it)
-    {
-      QueueRecord& qr = it->second;
-      if (queue_policy_->unload_incoming(*this, it->first, gid, qr.size))
-      {
-        log->debug("Unloading queue: {} <- {}", gid, it->first);
-        qr.external = storage_->put(in_qrs.queues[it->first]);
-      }
+      log->debug("Unloading queue: {} <- {}", gid, it->first);
+      qr.external = storage_->put(in_qrs.queues[it->first]);
     }
   }
 }
@@ -537,7 +742,7 @@ void
 diy::Master::
 unload_outgoing(int gid)
 {
-  OutgoingQueuesRecord& out_qr = outgoing_[gid];
+  OutgoingQueuesRecord& out_qr = entry(outgoing_, lid(gid));
 
   size_t out_queues_size = sizeof(size_t);   // map size
   size_t count = 0;
@@ -568,7 +773,7 @@ unload_outgoing(int gid)
             qr.size = it->second.size();
             qr.external = storage_->put(it->second);
 
-            out_qr.queues.erase(it++);
+            it = out_qr.queues.erase(it);
             continue;
           } // else keep in memory
         } else
@@ -576,7 +781,7 @@ unload_outgoing(int gid)
           diy::save(bb, it->first);
           diy::save(bb, it->second);
 
-          out_qr.queues.erase(it++);
+          it = out_qr.queues.erase(it);
           continue;
         }
         ++it;
@@ -610,14 +815,17 @@ void
 diy::Master::
 load_incoming(int gid)
 {
-  IncomingQueuesRecords& in_qrs = incoming_[exchange_round_].map[gid];
+  IncomingQueuesRecords& in_qrs = entry(incoming_[exchange_round_].map, lid(gid));
   for (InQueueRecords::iterator it = in_qrs.records.begin(); it != in_qrs.records.end(); ++it)
   {
     QueueRecord& qr = it->second;
     if (qr.external != -1)
     {
         log->debug("Loading queue: {} <- {}", gid, it->first);
-        storage_->get(qr.external, in_qrs.queues[it->first]);
+        MemoryBuffer& bb = in_qrs.queues[it->first];
+        bb.set_resource(queue_resource_);       // storage_ reads into the buffer's own storage
+        storage_->get(qr.external, bb);
+        bb.alignment = alignment_;
         qr.external = -1;
     }
   }
@@ -629,7 +837,7 @@ load_outgoing(int gid)
 {
   // TODO: we could adjust this mechanism to read directly from storage,
   //       bypassing an intermediate MemoryBuffer
-  OutgoingQueuesRecord& out_qr = outgoing_[gid];
+  OutgoingQueuesRecord& out_qr = entry(outgoing_, lid(gid));
   if (out_qr.external != -1)
   {
     MemoryBuffer bb;
@@ -642,7 +850,10 @@ load_outgoing(int gid)
     {
       BlockID to;
       diy::load(bb, to);
-      diy::load(bb, out_qr.queues[to]);
+      MemoryBuffer& queue = out_qr.queues[to];
+      queue.set_resource(queue_resource_);
+      diy::load(bb, queue);
+      queue.alignment = alignment_;
     }
   }
 }
@@ -667,7 +878,7 @@ add(int gid, void* b, Link* l)
   gids_.push_back(gid);
 
   int lid = gids_.size() - 1;
-  lids_[gid] = lid;
+  lids_.insert(gid, lid);
   add_expected(l->size_unique()); // NB: at every iteration we expect a message from each unique neighbor
 
   return lid;
@@ -687,7 +898,8 @@ bool
 diy::Master::
 has_incoming(int i) const
 {
-  const IncomingQueuesRecords& in_qrs = const_cast<Master&>(*this).incoming_[exchange_round_].map[gid(i)];
+  Master& self = const_cast<Master&>(*this);
+  const IncomingQueuesRecords& in_qrs = self.entry(self.incoming_[exchange_round_].map, i);
   for (InQueueRecords::const_iterator it = in_qrs.records.begin(); it != in_qrs.records.end(); ++it)
   {
     const QueueRecord& qr = it->second;
@@ -750,39 +962,66 @@ execute()
     blocks_per_thread = limit_/num_threads;
   }
 
-  // idx is shared
-  critical_resource<int> idx(0);
-
-  typedef                 ProcessBlock                                   BlockFunctor;
-  if (num_threads > 1)
+  // the scheduler is shared
+  std::unique_ptr<detail::BlockScheduler> scheduler;
+  if (schedule_ == Schedule::work_stealing)
+    scheduler.reset(new detail::WorkStealingScheduler(blocks, num_threads));
+  else
+    scheduler.reset(new detail::SharedIndexScheduler(blocks));
+
+  thread_stats_.assign(num_threads, ThreadStats());
+  ProcessBlock::Clock::time_point start = ProcessBlock::Clock::now();
+
+  detail::BlockScheduler& sched = *scheduler;
+  auto process = [this,blocks_per_thread,&sched](int i)
+                 {
+                   ProcessBlock bf(*this, i, blocks_per_thread, sched, thread_stats_[i]);
+                   bf.process();
+                 };
+  if (posting_)
   {
-    // launch the threads
-    typedef               std::pair<thread*, BlockFunctor*>               ThreadFunctorPair;
-    typedef               std::list<ThreadFunctorPair>                    ThreadFunctorList;
-    ThreadFunctorList     threads;
-    for (unsigned i = 0; i < (unsigned)num_threads; ++i)
+    // the queues of the next round may start arriving while the blocks are being processed, and so
+    // may those of the round after, from a process that is already done with the next one; make sure
+    // their records exist, so that receiving them doesn't modify the tables the threads use
+    for (int round = exchange_round_ + 1; round <= exchange_round_ + 2; ++round)
     {
-        BlockFunctor* bf = new BlockFunctor(*this, blocks, blocks_per_thread, idx);
-        threads.push_back(ThreadFunctorPair(new thread(&BlockFunctor::run, bf), bf));
+      IncomingQueuesMap& next_incoming = incoming_[round].map;
+      if (next_incoming.size() < size())
+        next_incoming.resize(size());
     }
 
-    // join the threads
-    for(ThreadFunctorList::iterator it = threads.begin(); it != threads.end(); ++it)
+    if (num_threads > 1)
+    {
+      // all MPI calls stay in this thread, while the pool processes the blocks
+      pool_.submit(num_threads, process);
+      while (!pool_.wait_for(std::chrono::microseconds(100)))
+        send_posted();
+      pool_.wait();
+    } else
     {
-        thread*           t  = it->first;
-        BlockFunctor*     bf = it->second;
-        t->join();
-        delete t;
-        delete bf;
+      ProcessBlock bf(*this, 0, blocks_per_thread, *scheduler, thread_stats_[0], true);
+      bf.process();
     }
+    send_posted();
+  } else if (num_threads > 1)
+  {
+    // run on the persistent worker threads
+    pool_.execute(num_threads, process);
   } else
   {
-      BlockFunctor bf(*this, blocks, blocks_per_thread, idx);
-      BlockFunctor::run(&bf);
+      ProcessBlock bf(*this, 0, blocks_per_thread, *scheduler, thread_stats_[0]);
+      bf.process();
   }
 
+  // whatever a thread didn't spend working, it spent idling, including the wait for the stragglers
+  double elapsed = std::chrono::duration<double>(ProcessBlock::Clock::now() - start).count();
+  for (size_t i = 0; i < thread_stats_.size(); ++i)
+    thread_stats_[i].idle = std::max(0., elapsed - thread_stats_[i].busy);
+
   // clear incoming queues
-  incoming_[exchange_round_].map.clear();
+  IncomingQueuesMap& current_incoming = incoming_[exchange_round_].map;
+  for (size_t i = 0; i < current_incoming.size(); ++i)
+    recycle(current_incoming[i]);
 
   if (limit() != -1 && in_memory() > limit())
       throw std::runtime_error(fmt::format("Fatal: {} blocks in memory, with limit {}", in_memory(), limit()));
@@ -798,15 +1037,21 @@ diy::Master::
 exchange()
 {
   auto scoped = prof.scoped("exchange");
+  posting_ = overlap_;
   execute();
+  posting_ = false;
 
   log->debug("Starting exchange");
 
   // make sure there is a queue for each neighbor
   for (int i = 0; i < (int)size(); ++i)
   {
-    OutgoingQueues&  outgoing_queues  = outgoing_[gid(i)].queues;
-    OutQueueRecords& external_local   = outgoing_[gid(i)].external_local;
+    OutgoingQueuesRecord& out = entry(outgoing_, i);
+    if (out.posted)
+      continue;               // already taken care of in post_outgoing()
+
+    OutgoingQueues&  outgoing_queues  = out.queues;
+    OutQueueRecords& external_local   = out.external_local;
     if (outgoing_queues.size() < (size_t)link(i)->size())
       for (unsigned j = 0; j < (unsigned)link(i)->size(); ++j)
       {
@@ -856,22 +1101,22 @@ void
 diy::Master::
 comm_exchange(ToSendList& to_send, int out_queues_limit)
 {
-  static const size_t MAX_MPI_MESSAGE_COUNT = INT_MAX;
-
   IncomingRound &current_incoming = incoming_[exchange_round_];
   // isend outgoing queues, up to the out_queues_limit
-  while(inflight_sends_.size() < (size_t)out_queues_limit && !to_send.empty())
+  while(inflight_sends_ < (size_t)out_queues_limit && !to_send.empty())
   {
-    int from = to_send.front();
+    int                   from_lid = to_send.front();
+    int                   from     = gid(from_lid);
+    OutgoingQueuesRecord& out      = outgoing_[from_lid];
 
     // deal with external_local queues
-    for (OutQueueRecords::iterator it = outgoing_[from].external_local.begin(); it != outgoing_[from].external_local.end(); ++it)
+    for (OutQueueRecords::iterator it = out.external_local.begin(); it != out.external_local.end(); ++it)
     {
       int to = it->first.gid;
 
       log->debug("Processing local queue: {} <- {} of size {}", to, from, it->second.size);
 
-      QueueRecord& in_qr  = current_incoming.map[to].records[from];
+      QueueRecord& in_qr  = entry(current_incoming.map, lid(to)).records[from];
       bool in_external  = block(lid(to)) == 0;
 
       if (in_external)
@@ -883,33 +1128,37 @@ comm_exchange(ToSendList& to_send, int out_queues_limit)
           in_qr.external = -1;
 
           MemoryBuffer bb;
+          bb.set_resource(queue_resource_);
           storage_->get(it->second.external, bb);
+          bb.alignment = alignment_;
 
-          current_incoming.map[to].queues[from].swap(bb);
+          current_incoming.map[lid(to)].queues[from].swap(bb);
       }
       ++current_incoming.received;
     }
-    outgoing_[from].external_local.clear();
+    out.external_local.clear();
 
-    if (outgoing_[from].external != -1)
+    if (out.external != -1)
       load_outgoing(from);
     to_send.pop_front();
 
-    OutgoingQueues& outgoing = outgoing_[from].queues;
+    OutgoingQueues& outgoing = out.queues;
     for (OutgoingQueues::iterator it = outgoing.begin(); it != outgoing.end(); ++it)
     {
       BlockID to_proc = it->first;
       int     to      = to_proc.gid;
       int     proc    = to_proc.proc;
 
-      log->debug("Processing queue:      {} <- {} of size {}", to, from, outgoing_[from].queues[to_proc].size());
+      log->debug("Processing queue:      {} <- {} of size {}", to, from, it->second.size());
+      out.sizes[to_proc] = it->second.size();
 
       // There may be local outgoing queues that remained in memory
       if (proc == comm_.rank())     // sending to ourselves: simply swap buffers
       {
         log->debug("Moving queue in-place: {} <- {}", to, from);
 
-        QueueRecord& in_qr  = current_incoming.map[to].records[from];
+        IncomingQueuesRecords& in_qrs = entry(current_incoming.map, lid(to));
+        QueueRecord& in_qr  = in_qrs.records[from];
         bool in_external  = block(lid(to)) == 0;
         if (in_external)
         {
@@ -920,17 +1169,19 @@ comm_exchange(ToSendList& to_send, int out_queues_limit)
             in_qr.external = storage_->put(bb);
           else
           {
-            MemoryBuffer& in_bb = current_incoming.map[to].queues[from];
+            MemoryBuffer& in_bb = in_qrs.queues[from];
             in_bb.swap(bb);
             in_bb.reset();
+            in_bb.alignment = alignment_;
             in_qr.external = -1;
           }
         } else        // !in_external
         {
           log->debug("Swapping in memory:    {} <- {}", to, from);
-          MemoryBuffer& bb = current_incoming.map[to].queues[from];
+          MemoryBuffer& bb = in_qrs.queues[from];
           bb.swap(it->second);
           bb.reset();
+          bb.alignment = alignment_;
           in_qr.size = bb.size();
           in_qr.external = -1;
         }
@@ -939,123 +1190,339 @@ comm_exchange(ToSendList& to_send, int out_queues_limit)
         continue;
       }
 
-      std::shared_ptr<MemoryBuffer> buffer = std::make_shared<MemoryBuffer>();
-      buffer->swap(it->second);
-
-      MessageInfo info{from, to, exchange_round_};
-      if (buffer->size() <= (MAX_MPI_MESSAGE_COUNT - sizeof(info)))
+      if (aggregate_)
       {
-        diy::save(*buffer, info);
+        aggregated_[proc].emplace_back();
+        aggregated_[proc].back().from = from;
+        aggregated_[proc].back().to   = to_proc;
+        aggregated_[proc].back().queue.swap(it->second);
+      } else
+        send_queue(from, to, proc, it->second, exchange_round_);
+    }
+  }
 
-        inflight_sends_.emplace_back();
-        inflight_sends_.back().info = info;
-        inflight_sends_.back().request = comm_.isend(proc, tags::queue, buffer->buffer);
-        inflight_sends_.back().message = buffer;
-      }
-      else
-      {
-        int npieces = static_cast<int>((buffer->size() + MAX_MPI_MESSAGE_COUNT - 1)/MAX_MPI_MESSAGE_COUNT);
+  // queuing up doesn't count towards out_queues_limit, so at this point every queue has been visited
+  if (to_send.empty() && !aggregated_.empty())
+    send_aggregated(exchange_round_);
 
-        // first send the head
-        std::shared_ptr<MemoryBuffer> hb = std::make_shared<MemoryBuffer>();
-        diy::save(*hb, buffer->size());
-        diy::save(*hb, info);
+  // kick requests
+  while(nudge());
+}
 
-        inflight_sends_.emplace_back();
-        inflight_sends_.back().info = info;
-        inflight_sends_.back().request = comm_.isend(proc, tags::piece, hb->buffer);
-        inflight_sends_.back().message = hb;
+void
+diy::Master::
+send_queue(int from, int to, int proc, MemoryBuffer& queue, int round, int tag)
+{
+  std::shared_ptr<MemoryBuffer> buffer = std::make_shared<MemoryBuffer>();
+  buffer->swap(queue);
 
-        // send the message pieces
-        size_t msg_buff_idx = 0;
-        for (int i = 0; i < npieces; ++i, msg_buff_idx += MAX_MPI_MESSAGE_COUNT)
-        {
-          int tag = (i == (npieces - 1)) ? tags::queue : tags::piece;
+  int& seq = sequence_[proc];
 
-          detail::VectorWindow<char> window;
-          window.begin = &buffer->buffer[msg_buff_idx];
-          window.count = std::min(MAX_MPI_MESSAGE_COUNT, buffer->size() - msg_buff_idx);
+  MessageHeader header;
+  header.info = MessageInfo{from, to, round};
+  header.size = buffer->size();
+  header.tag  = tag;
+  header.seq  = seq;
+  seq = (seq + 1) % payload_tags();
 
-          inflight_sends_.emplace_back();
-          inflight_sends_.back().info = info;
-          inflight_sends_.back().request = comm_.isend(proc, tag, window);
-          inflight_sends_.back().message = buffer;
-        }
-      }
-    }
+  if (header.size <= eager_size())
+  {
+    // the header goes behind the queue, in the same message
+    diy::save(*buffer, header);
+    post_send(proc, tags::header, buffer, &buffer->buffer[0], buffer->size());
+    return;
   }
 
-  // kick requests
-  while(nudge());
+  std::shared_ptr<MemoryBuffer> hb = std::make_shared<MemoryBuffer>();
+  hb->buffer = buffers_.access()->acquire(proc, sizeof(MessageHeader), queue_resource_);
+  diy::save(*hb, header);
+  post_send(proc, tags::header, hb, &hb->buffer[0], hb->size());
 
-  // check incoming queues
-  mpi::optional<mpi::status> ostatus = comm_.iprobe(mpi::any_source, mpi::any_tag);
-  while(ostatus)
+  // the payload, in pieces if it exceeds max_piece_size()
+  int payload_tag = tags::payload + header.seq;
+  for (size_t offset = 0; offset < buffer->size(); offset += max_piece_size())
+    post_send(proc, payload_tag, buffer, &buffer->buffer[offset], std::min(max_piece_size(), buffer->size() - offset));
+}
+
+void
+diy::Master::
+post_send(int proc, int tag, std::shared_ptr<MemoryBuffer> message, const void* address, size_t count)
+{
+  if (count > (size_t) std::numeric_limits<int>::max())
+    requests_.push_back(comm_.isend(proc, tag, address, mpi::large_datatype(count)));
+  else
   {
-    InFlightRecv &ir = inflight_recvs_[ostatus->source()];
+    detail::VectorWindow<char> window;
+    window.begin = const_cast<char*>(static_cast<const char*>(address));
+    window.count = count;
 
-    if (ir.info.from == -1) // uninitialized
-    {
-      MemoryBuffer bb;
-      comm_.recv(ostatus->source(), ostatus->tag(), bb.buffer);
+    requests_.push_back(comm_.isend(proc, tag, window));
+  }
+  inflight_.push_back(InFlight{tags::queue, proc, message, std::shared_ptr<InFlightRecv>()});
+  ++inflight_sends_;
+}
 
-      if (ostatus->tag() == tags::piece)
-      {
-        size_t msg_size;
-        diy::load(bb, msg_size);
-        diy::load(bb, ir.info);
+void
+diy::Master::
+post_recv(int proc, int tag, std::shared_ptr<InFlightRecv> recv, void* address, size_t count)
+{
+  if (count > (size_t) std::numeric_limits<int>::max())
+    requests_.push_back(comm_.irecv(proc, tag, address, mpi::large_datatype(count)));
+  else
+  {
+    detail::VectorWindow<char> window;
+    window.begin = static_cast<char*>(address);
+    window.count = count;
 
-        ir.message.buffer.reserve(msg_size);
-      }
-      else // tags::queue
-      {
-        diy::load_back(bb, ir.info);
-        ir.message.swap(bb);
-      }
-    }
+    requests_.push_back(comm_.irecv(proc, tag, window));
+  }
+  inflight_.push_back(InFlight{tags::payload, proc, std::shared_ptr<MemoryBuffer>(), recv});
+  ++recv->pieces;
+}
+
+void
+diy::Master::
+post_header_slots()
+{
+  if (target_header_slots_ == 0)
+  {
+    // one slot per neighboring process, within limits
+    std::vector<int> procs;
+    for (unsigned i = 0; i < size(); ++i)
+      if (link(i))
+        for (int j = 0; j < link(i)->size(); ++j)
+          if (link(i)->target(j).proc != comm_.rank())
+            procs.push_back(link(i)->target(j).proc);
+    std::sort(procs.begin(), procs.end());
+    target_header_slots_ = std::max(1, std::min(max_header_slots(), (int) (std::unique(procs.begin(), procs.end()) - procs.begin())));
+  }
+
+  if (header_slots_ == target_header_slots_)
+    return;
+
+  critical_resource<detail::BufferPool, mutex>::accessor pool = buffers_.access();
+  for (; header_slots_ < target_header_slots_; ++header_slots_)
+  {
+    std::shared_ptr<InFlightRecv> recv = std::make_shared<InFlightRecv>();
+    recv->message.buffer = pool->acquire(-1, eager_size() + sizeof(MessageHeader), queue_resource_);
+    recv->message.buffer.resize(eager_size() + sizeof(MessageHeader));
+
+    requests_.push_back(comm_.irecv(mpi::any_source, tags::header, recv->message.buffer));
+    inflight_.push_back(InFlight{tags::header, mpi::any_source, std::shared_ptr<MemoryBuffer>(), recv});
+  }
+}
+
+void
+diy::Master::
+cancel_header_slots()
+{
+  for (size_t j = 0; j < requests_.size(); ++j)
+  {
+    if (inflight_[j].tag != tags::header)
+      continue;
+
+    requests_[j].cancel();
+    mpi::status status = requests_[j].wait();
+    if (!status.cancelled())                    // a message for a later round got here first
+      receive_header(inflight_[j].recv, status);
     else
-    {
-      size_t start_idx = ir.message.buffer.size();
-      size_t count = ostatus->count<char>();
-      ir.message.buffer.resize(start_idx + count);
+      buffers_.access()->release(-1, inflight_[j].recv->message.buffer);
+  }
+  header_slots_        = 0;
+  target_header_slots_ = 0;
+  compact_requests();
+}
 
-      detail::VectorWindow<char> window;
-      window.begin = &ir.message.buffer[start_idx];
-      window.count = count;
+void
+diy::Master::
+receive_header(std::shared_ptr<InFlightRecv> recv, const mpi::status& status)
+{
+  MemoryBuffer& message = recv->message;
+  message.buffer.resize(status.count<char>());
+  diy::load_back(message, recv->header);
+  recv->source = status.source();
 
-      comm_.recv(ostatus->source(), ostatus->tag(), window);
-    }
+  if (message.size() == recv->header.size)     // the queue came along
+  {
+    place_message(*recv);
+    return;
+  }
 
-    if (ostatus->tag() == tags::queue)
-    {
-      size_t size  = ir.message.size();
-      int from = ir.info.from;
-      int to = ir.info.to;
-      int external = -1;
+  // receive the payload directly into a buffer of the final size, in the pieces it was sent in
+  {
+    critical_resource<detail::BufferPool, mutex>::accessor pool = buffers_.access();
+    pool->release(-1, message.buffer);
+    message.buffer = pool->acquire(recv->source, recv->header.size, queue_resource_);
+  }
+  message.buffer.resize(recv->header.size);
+  int payload_tag = tags::payload + recv->header.seq;
+  for (size_t offset = 0; offset < message.size(); offset += max_piece_size())
+    post_recv(status.source(), payload_tag, recv, &message.buffer[offset], std::min(max_piece_size(), message.size() - offset));
+}
+
+void
+diy::Master::
+place_message(InFlightRecv& recv)
+{
+  MemoryBuffer&         message = recv.message;
+  const MessageInfo&    info    = recv.header.info;
+
+  if (recv.header.tag == tags::queue)
+  {
+    place_incoming(info.from, info.to, info.round, message);
+    return;
+  }
+
+  // tags::aggregate: table of (from, to, size), followed by the queues themselves
+  size_t count;
+  diy::load(message, count);
+
+  std::vector<int>      from(count), to(count);
+  std::vector<size_t>   sizes(count);
+  for (size_t j = 0; j < count; ++j)
+  {
+    diy::load(message, from[j]);
+    diy::load(message, to[j]);
+    diy::load(message, sizes[j]);
+  }
+
+  for (size_t j = 0; j < count; ++j)
+  {
+    MemoryBuffer queue;
+    queue.buffer = buffers_.access()->acquire(recv.source, sizes[j], queue_resource_);
+    queue.buffer.resize(sizes[j]);
+    if (sizes[j])
+      message.load_binary(&queue.buffer[0], sizes[j]);
+    place_incoming(from[j], to[j], info.round, queue);
+  }
+  buffers_.access()->release(recv.source, message.buffer);
+}
+
+void
+diy::Master::
+place_incoming(int from, int to, int round, MemoryBuffer& queue)
+{
+  size_t size     = queue.size();
+  int    external = -1;
+
+  assert(round >= exchange_round_);
+  IncomingRound *in = &incoming_[round];
+  IncomingQueuesRecords& in_qrs = entry(in->map, lid(to));
+
+  bool unload_queue = ((round == exchange_round_) ? (block(lid(to)) == 0) : (limit_ != -1)) &&
+                      queue_policy_->unload_incoming(*this, from, to, size);
+  if (unload_queue)
+  {
+    log->debug("Directly unloading queue {} <- {}", to, from);
+    external = storage_->put(queue); // unload directly
+  }
+  else
+  {
+    MemoryBuffer& bb = in_qrs.queues[from];
+    bb.swap(queue);
+    bb.reset();     // buffer position = 0
+    bb.alignment = alignment_;      // the queue arrives as raw bytes; read it in the framing it was written in
+  }
+  in_qrs.records[from] = QueueRecord(size, external);
+
+  ++(in->received);
+}
+
+void
+diy::Master::
+send_aggregated(int round)
+{
+  for (AggregatedQueues::iterator it = aggregated_.begin(); it != aggregated_.end(); ++it)
+  {
+    int             proc   = it->first;
+    PostedQueues&   queues = it->second;
 
-      assert(ir.info.round >= exchange_round_);
-      IncomingRound *in = &incoming_[ir.info.round];
+    size_t total = sizeof(size_t) + queues.size() * (2*sizeof(int) + sizeof(size_t));
+    for (size_t j = 0; j < queues.size(); ++j)
+      total += queues[j].queue.size();
 
-      bool unload_queue = ((ir.info.round == exchange_round_) ? (block(lid(to)) == 0) : (limit_ != -1)) &&
-                          queue_policy_->unload_incoming(*this, from, to, size);
-      if (unload_queue)
+    MemoryBuffer bb;
+    {
+      critical_resource<detail::BufferPool, mutex>::accessor pool = buffers_.access();
+      bb.buffer = pool->acquire(proc, total + sizeof(MessageHeader), queue_resource_);
+      diy::save(bb, queues.size());
+      for (size_t j = 0; j < queues.size(); ++j)
       {
-        log->debug("Directly unloading queue {} <- {}", to, from);
-        external = storage_->put(ir.message); // unload directly
+        diy::save(bb, queues[j].from);
+        diy::save(bb, queues[j].to.gid);
+        diy::save(bb, queues[j].queue.size());
       }
-      else
+      for (size_t j = 0; j < queues.size(); ++j)
       {
-        in->map[to].queues[from].swap(ir.message);
-        in->map[to].queues[from].reset();     // buffer position = 0
+        if (queues[j].queue.size())
+          bb.save_binary(&queues[j].queue.buffer[0], queues[j].queue.size());
+        pool->release(proc, queues[j].queue.buffer);
       }
-      in->map[to].records[from] = QueueRecord(size, external);
+    }
+
+    log->debug("Sending {} queues to {} in one message of size {}", queues.size(), proc, bb.size());
+
+    // the sender's rank stands in for the source gid; the targets are in the table
+    send_queue(comm_.rank(), -1, proc, bb, round, tags::aggregate);
+  }
+  aggregated_.clear();
+}
 
-      ++(in->received);
-      ir = InFlightRecv(); // reset
+void
+diy::Master::
+post_outgoing(int i)
+{
+  int                   from = gid(i);
+  OutgoingQueuesRecord& out  = entry(outgoing_, i);
+  if (out.external != -1)
+    load_outgoing(from);
+
+  // make sure there is a queue for each neighbor
+  for (int j = 0; j < link(i)->size(); ++j)
+  {
+    if (out.external_local.find(link(i)->target(j)) == out.external_local.end())
+      out.queues[link(i)->target(j)];
+  }
+
+  // local queues are left for flush(); it just swaps them into place
+  critical_resource<PostedQueues, mutex>::accessor posted = posted_.access();
+  for (OutgoingQueues::iterator it = out.queues.begin(); it != out.queues.end();)
+  {
+    if (it->first.proc == comm_.rank())
+    {
+      ++it;
+      continue;
     }
 
-    ostatus = comm_.iprobe(mpi::any_source, mpi::any_tag);
+    out.sizes[it->first] = it->second.size();
+    posted->emplace_back();
+    posted->back().from = from;
+    posted->back().to   = it->first;
+    posted->back().queue.swap(it->second);
+    it = out.queues.erase(it);
   }
+  out.posted = true;
+}
+
+void
+diy::Master::
+send_posted()
+{
+  PostedQueues posted;
+  posted_.access()->swap(posted);
+
+  // these queues belong to the round that the upcoming flush() starts
+  if (aggregate_)
+  {
+    // one message per process for the queues posted since the last call
+    for (size_t j = 0; j < posted.size(); ++j)
+      aggregated_[posted[j].to.proc].push_back(std::move(posted[j]));
+    send_aggregated(exchange_round_ + 1);
+  } else
+    for (size_t j = 0; j < posted.size(); ++j)
+      send_queue(posted[j].from, posted[j].to.gid, posted[j].to.proc, posted[j].queue, exchange_round_ + 1);
+
+  while(nudge());
 }
 
 void
@@ -1073,13 +1540,13 @@ flush()
 
   // make a list of outgoing queues to send (the ones in memory come first)
   ToSendList    to_send;
-  for (OutgoingQueuesMap::iterator it = outgoing_.begin(); it != outgoing_.end(); ++it)
+  for (size_t i = 0; i < outgoing_.size(); ++i)
   {
-    OutgoingQueuesRecord& out = it->second;
+    OutgoingQueuesRecord& out = outgoing_[i];
     if (out.external == -1)
-        to_send.push_front(it->first);
+        to_send.push_front(i);
     else
-        to_send.push_back(it->first);
+        to_send.push_back(i);
   }
   log->debug("to_send.size(): {}", to_send.size());
 
@@ -1091,22 +1558,32 @@ flush()
   else
     out_queues_limit = std::max((size_t) 1, to_send.size()/size()*limit_);      // average number of queues per block * in-memory block limit
 
-  do
+  while (true)
   {
     comm_exchange(to_send, out_queues_limit);
 
+    if (inflight_sends_ == 0 && incoming_[exchange_round_].received >= expected_ && to_send.empty())
+      break;
+
+    // sleep until a request completes, unless there is room to send more queues
+    if (blocking_ && (to_send.empty() || inflight_sends_ >= (size_t) out_queues_limit))
+      nudge(true);
+
 #ifdef DEBUG
     time_type cur = get_time();
     if (cur - start > wait*1000)
     {
         log->notice("Waiting in flush [{}]: {} - {} out of {}",
-                    comm_.rank(), inflight_sends_.size(), incoming_[exchange_round_].received, expected_);
+                    comm_.rank(), inflight_sends_, incoming_[exchange_round_].received, expected_);
         wait *= 2;
     }
 #endif
-  } while (!inflight_sends_.empty() || incoming_[exchange_round_].received < expected_ || !to_send.empty());
+  }
+  cancel_header_slots();
 
-  outgoing_.clear();
+  for (size_t i = 0; i < outgoing_.size(); ++i)
+    outgoing_[i].clear();
+  buffers_.access()->trim();        // keep what this round and the previous one released
 
   log->debug("Done in flush");
   //show_incoming_records();
@@ -1125,14 +1602,10 @@ process_collectives()
 
   typedef       CollectivesList::iterator       CollectivesIterator;
   std::vector<CollectivesIterator>  iters;
-  std::vector<int>                  gids;
   for (CollectivesMap::iterator cur = collectives_.begin(); cur != collectives_.end(); ++cur)
-  {
-    gids.push_back(cur->first);
-    iters.push_back(cur->second.begin());
-  }
+    iters.push_back(cur->begin());
 
-  while (iters[0] != collectives_.begin()->second.end())
+  while (iters[0] != collectives_.front().end())
   {
     iters[0]->init();
     for (unsigned j = 1; j < iters.size(); ++j)
@@ -1154,21 +1627,137 @@ process_collectives()
 
 bool
 diy::Master::
-nudge()
+nudge(bool wait)
 {
-  bool success = false;
-  for (InFlightSendsList::iterator it = inflight_sends_.begin(); it != inflight_sends_.end(); ++it)
+  post_header_slots();
+
+  std::vector<int>&         completed = completed_;
+  std::vector<mpi::status>& statuses  = statuses_;
+  if (wait)
+    mpi::wait_some(requests_, completed, statuses);
+  else
+    mpi::test_some(requests_, completed, statuses);
+
+  if (completed.empty())
+    return false;
+
+  for (size_t k = 0; k < completed.size(); ++k)
   {
-    mpi::optional<mpi::status> ostatus = it->request.test();
-    if (ostatus)
+    InFlight f;
+    std::swap(f, inflight_[completed[k]]);      // the handlers below may add requests
+
+    if (f.tag == tags::queue)
     {
-      success = true;
-      InFlightSendsList::iterator rm = it;
-      --it;
-      inflight_sends_.erase(rm);
+      --inflight_sends_;
+      if (f.send.use_count() == 1)                // the last piece of the message went out
+        buffers_.access()->release(f.proc, f.send->buffer);
     }
+    else if (f.tag == tags::header)
+    {
+      --header_slots_;
+      receive_header(f.recv, statuses[k]);
+    } else if (--f.recv->pieces == 0)             // tags::payload
+      place_message(*f.recv);
+  }
+  compact_requests();
+
+  return true;
+}
+
+void
+diy::Master::
+compact_requests()
+{
+  // drop the completed requests, which MPI set to MPI_REQUEST_NULL
+  size_t last = 0;
+  for (size_t j = 0; j < requests_.size(); ++j)
+  {
+    if (requests_[j].r == MPI_REQUEST_NULL)
+      continue;
+    if (last != j)
+    {
+      requests_[last] = requests_[j];
+      inflight_[last] = std::move(inflight_[j]);
+    }
+    ++last;
+  }
+  requests_.resize(last);
+  inflight_.resize(last);
+}
+
+void
+diy::Master::
+cancel_requests()
+{
+  // only the receives for a later round can still be outstanding
+  for (size_t j = 0; j < requests_.size(); ++j)
+  {
+    if (inflight_[j].tag != tags::queue)
+      requests_[j].cancel();
+    requests_[j].wait();
+  }
+  requests_.clear();
+  inflight_.clear();
+  inflight_sends_ = 0;
+  header_slots_   = 0;
+}
+
+// called by the threads processing the blocks, through Proxy
+diy::MemoryBuffer&
+diy::Master::
+outgoing_queue(OutgoingQueues& queues, const OutQueueSizes& sizes, const BlockID& to)
+{
+  OutgoingQueues::iterator it = queues.find(to);
+  if (it != queues.end())
+  {
+    it->second.alignment = alignment_;      // the queue may have been created empty, by comm_exchange()
+    return it->second;
+  }
+
+  MemoryBuffer& bb = queues[to];
+  OutQueueSizes::const_iterator size = sizes.find(to);
+  if (size != sizes.end() && size->second)
+    bb.buffer = buffers_.access()->acquire(to.proc, size->second + sizeof(MessageHeader), queue_resource_);  // room for the header of an eager message
+  else
+    bb.set_resource(queue_resource_);
+  bb.alignment = alignment_;
+  return bb;
+}
+
+void
+diy::Master::
+update_queue_resource()
+{
+  if (alignment_ <= alignof(std::max_align_t))
+  {
+    queue_resource_ = resource_;
+    return;
+  }
+
+  // the earlier adapters stay around, for the storage already allocated through them
+  for (size_t i = 0; i < aligned_resources_.size(); ++i)
+    if (aligned_resources_[i]->alignment() == alignment_ && aligned_resources_[i]->upstream() == resource_)
+    {
+      queue_resource_ = aligned_resources_[i].get();
+      return;
+    }
+
+  aligned_resources_.emplace_back(new AlignedResource(alignment_, resource_));
+  queue_resource_ = aligned_resources_.back().get();
+}
+
+// called by the threads processing the blocks
+void
+diy::Master::
+recycle(IncomingQueuesRecords& in)
+{
+  if (!in.queues.empty())
+  {
+    critical_resource<detail::BufferPool, mutex>::accessor pool = buffers_.access();
+    for (IncomingQueues::iterator it = in.queues.begin(); it != in.queues.end(); ++it)
+      pool->release(-1, it->second.buffer);
   }
-  return success;
+  in.clear();
 }
 
 void
@@ -1177,15 +1766,16 @@ show_incoming_records() const
 {
   for (IncomingRoundMap::const_iterator rounds_itr = incoming_.begin(); rounds_itr != incoming_.end(); ++rounds_itr)
   {
-    for (IncomingQueuesMap::const_iterator it = rounds_itr->second.map.begin(); it != rounds_itr->second.map.end(); ++it)
+    const IncomingQueuesMap& in = rounds_itr->second.map;
+    for (size_t i = 0; i < in.size(); ++i)
     {
-      const IncomingQueuesRecords& in_qrs = it->second;
+      const IncomingQueuesRecords& in_qrs = in[i];
       for (InQueueRecords::const_iterator cur = in_qrs.records.begin(); cur != in_qrs.records.end(); ++cur)
       {
         const QueueRecord& qr = cur->second;
         log->info("round: {}, {} <- {}: (size,external) = ({},{})",
                   rounds_itr->first,
-                  it->first, cur->first,
+                  gid(i), cur->first,
                   qr.size,
                   qr.external);
       }
@@ -1193,8 +1783,8 @@ show_incoming_records() const
       {
         log->info("round: {}, {} <- {}: queue.size() = {}",
                   rounds_itr->first,
-                  it->first, cur->first,
-                  const_cast<IncomingQueuesRecords&>(in_qrs).queues[cur->first].size());
+                  gid(i), cur->first,
+                  cur->second.size());
       }
     }
   }
@@ -3,6 +3,8 @@
 
 #include <mpi.h>
 
+#include "resource.hpp"
+
 #include "mpi/constants.hpp"
 #include "mpi/datatypes.hpp"
 #include "mpi/optional.hpp"
@@ -12,6 +14,7 @@
 #include "mpi/communicator.hpp"
 #include "mpi/collectives.hpp"
 #include "mpi/io.hpp"
+#include "mpi/resource.hpp"
 
 namespace diy
 {
@@ -23,7 +26,15 @@ struct environment
 {
   environment()                           { int argc = 0; char** argv; MPI_Init(&argc, &argv); }
   environment(int argc, char* argv[])     { MPI_Init(&argc, &argv); }
+  //! Initializes MPI at (at least, if supported) the `required` level of thread support, e.g. `MPI_THREAD_MULTIPLE`.
+  environment(int argc, char* argv[], int required)
+                                          { MPI_Init_thread(&argc, &argv, required, &provided_); }
   ~environment()                          { MPI_Finalize(); }
+
+  int   provided() const                  { return provided_; }   //!< the level of thread support MPI provides
+
+  private:
+    int provided_ = MPI_THREAD_SINGLE;
 };
 
 }
@@ -37,6 +37,14 @@ namespace mpi
       template<class T>
       request   irecv(int source, int tag, T& x) const      { return detail::irecv<T>()(comm_, source, tag, x); }
 
+      //! Non-blocking send of one element of `type`, starting at `address`.
+      request   isend(int dest, int tag, const void* address, const datatype& type) const
+      { request r; MPI_Isend(const_cast<void*>(address), 1, type.handle(), dest, tag, comm_, &r.r); return r; }
+
+      //! Non-blocking receive of one element of `type` into `address`.
+      request   irecv(int source, int tag, void* address, const datatype& type) const
+      { request r; MPI_Irecv(address, 1, type.handle(), source, tag, comm_, &r.r); return r; }
+
       //! probe
       status    probe(int source, int tag) const            { status s; MPI_Probe(source, tag, comm_, &s.s); return s; }
 
@@ -2,6 +2,9 @@
 #define DIY_MPI_DATATYPES_HPP
 
 #include <vector>
+#include <utility>
+#include <cassert>
+#include <limits>
 
 namespace diy
 {
@@ -35,6 +38,10 @@ namespace detail
   DIY_MPI_DATATYPE_MAP(float,                 MPI_FLOAT);
   DIY_MPI_DATATYPE_MAP(double,                MPI_DOUBLE);
 
+  // vectors with other allocators (e.g., MemoryBuffer::Buffer)
+  template<class U, class A>
+  struct is_mpi_datatype< std::vector<U, A> >   { typedef typename is_mpi_datatype<U>::type type; };
+
   /* mpi_datatype: helper routines, specialized for std::vector<...> */
   template<class T>
   struct mpi_datatype
@@ -45,10 +52,10 @@ namespace detail
     static int                  count(const T& x)       { return 1; }
   };
 
-  template<class U>
-  struct mpi_datatype< std::vector<U> >
+  template<class U, class A>
+  struct mpi_datatype< std::vector<U, A> >
   {
-    typedef     std::vector<U>      VecU;
+    typedef     std::vector<U, A>   VecU;
 
     static MPI_Datatype         datatype()              { return get_mpi_datatype<U>(); }
     static const void*          address(const VecU& x)  { return &x[0]; }
@@ -57,6 +64,49 @@ namespace detail
   };
 
 }
+
+  //! \ingroup MPI
+  //! Owns a committed derived datatype; frees it when it goes out of scope.
+  //! (Communication that is still using the datatype completes normally.)
+  class datatype
+  {
+    public:
+                    datatype(MPI_Datatype type = MPI_DATATYPE_NULL):
+                      type_(type)                       {}
+                    datatype(datatype&& other):
+                      type_(other.type_)                { other.type_ = MPI_DATATYPE_NULL; }
+                    ~datatype()                         { if (type_ != MPI_DATATYPE_NULL) MPI_Type_free(&type_); }
+
+                    datatype(const datatype&)           = delete;
+      datatype&     operator=(const datatype&)          = delete;
+      datatype&     operator=(datatype&& other)         { std::swap(type_, other.type_); return *this; }
+
+      MPI_Datatype  handle() const                      { return type_; }
+
+    private:
+      MPI_Datatype  type_;
+  };
+
+  //! A single element spanning `count` bytes, where `count` may exceed the largest `int`:
+  //! `count / chunk` contiguous chunks of `chunk` bytes followed by the remainder.
+  inline datatype   large_datatype(size_t count, size_t chunk = size_t(1) << 30)
+  {
+    assert(chunk <= (size_t) std::numeric_limits<int>::max() && count / chunk <= (size_t) std::numeric_limits<int>::max());
+
+    MPI_Datatype    chunk_type;
+    MPI_Type_contiguous(static_cast<int>(chunk), MPI_BYTE, &chunk_type);
+
+    int             blocklengths[2]  = { static_cast<int>(count / chunk), static_cast<int>(count % chunk) };
+    MPI_Aint        displacements[2] = { 0, static_cast<MPI_Aint>(count / chunk * chunk) };
+    MPI_Datatype    types[2]         = { chunk_type, MPI_BYTE };
+
+    MPI_Datatype    type;
+    MPI_Type_create_struct(blocklengths[1] ? 2 : 1, blocklengths, displacements, types, &type);
+    MPI_Type_commit(&type);
+    MPI_Type_free(&chunk_type);
+
+    return datatype(type);
+  }
 }
 }
 
@@ -45,17 +45,17 @@ namespace io
       inline void   write_at(offset o, const char* buffer, size_t size);
       inline void   write_at_all(offset o, const char* buffer, size_t size);
 
-      template<class T>
-      inline void   read_at(offset o, std::vector<T>& data);
+      template<class T, class A>
+      inline void   read_at(offset o, std::vector<T, A>& data);
 
-      template<class T>
-      inline void   read_at_all(offset o, std::vector<T>& data);
+      template<class T, class A>
+      inline void   read_at_all(offset o, std::vector<T, A>& data);
 
-      template<class T>
-      inline void   write_at(offset o, const std::vector<T>& data);
+      template<class T, class A>
+      inline void   write_at(offset o, const std::vector<T, A>& data);
 
-      template<class T>
-      inline void   write_at_all(offset o, const std::vector<T>& data);
+      template<class T, class A>
+      inline void   write_at_all(offset o, const std::vector<T, A>& data);
 
       const communicator&
                     comm() const                            { return comm_; }
@@ -78,10 +78,10 @@ read_at(offset o, char* buffer, size_t size)
   MPI_File_read_at(fh, o, buffer, size, detail::get_mpi_datatype<char>(), &s.s);
 }
 
-template<class T>
+template<class T, class A>
 void
 diy::mpi::io::file::
-read_at(offset o, std::vector<T>& data)
+read_at(offset o, std::vector<T, A>& data)
 {
   read_at(o, &data[0], data.size()*sizeof(T));
 }
@@ -94,10 +94,10 @@ read_at_all(offset o, char* buffer, size_t size)
   MPI_File_read_at_all(fh, o, buffer, size, detail::get_mpi_datatype<char>(), &s.s);
 }
 
-template<class T>
+template<class T, class A>
 void
 diy::mpi::io::file::
-read_at_all(offset o, std::vector<T>& data)
+read_at_all(offset o, std::vector<T, A>& data)
 {
   read_at_all(o, (char*) &data[0], data.size()*sizeof(T));
 }
@@ -110,10 +110,10 @@ write_at(offset o, const char* buffer, size_t size)
   MPI_File_write_at(fh, o, (void *)buffer, size, detail::get_mpi_datatype<char>(), &s.s);
 }
 
-template<class T>
+template<class T, class A>
 void
 diy::mpi::io::file::
-write_at(offset o, const std::vector<T>& data)
+write_at(offset o, const std::vector<T, A>& data)
 {
   write_at(o, (const char*) &data[0], data.size()*sizeof(T));
 }
@@ -126,10 +126,10 @@ write_at_all(offset o, const char* buffer, size_t size)
   MPI_File_write_at_all(fh, o, (void *)buffer, size, detail::get_mpi_datatype<char>(), &s.s);
 }
 
-template<class T>
+template<class T, class A>
 void
 diy::mpi::io::file::
-write_at_all(offset o, const std::vector<T>& data)
+write_at_all(offset o, const std::vector<T, A>& data)
 {
   write_at_all(o, &data[0], data.size()*sizeof(T));
 }
@@ -42,10 +42,10 @@ namespace detail
     }
   };
 
-  template<class U>
-  struct recv<std::vector<U>, true_type>
+  template<class U, class A>
+  struct recv<std::vector<U, A>, true_type>
   {
-    status operator()(MPI_Comm comm, int source, int tag, std::vector<U>& x) const
+    status operator()(MPI_Comm comm, int source, int tag, std::vector<U, A>& x) const
     {
       status s;
 
@@ -1,3 +1,5 @@
+#include <vector>
+
 namespace diy
 {
 namespace mpi
@@ -11,6 +13,36 @@ namespace mpi
 
     MPI_Request         r;
   };
+
+  //! Test the requests (MPI_Testsome); fill `indices` and `statuses` with the ones that completed.
+  //! The completed requests are set to MPI_REQUEST_NULL.
+  inline void           test_some(std::vector<request>& requests, std::vector<int>& indices, std::vector<status>& statuses);
+
+  //! Wait until at least one of the requests completes (MPI_Waitsome); otherwise same as test_some().
+  inline void           wait_some(std::vector<request>& requests, std::vector<int>& indices, std::vector<status>& statuses);
+
+namespace detail
+{
+  typedef int (*SomeFunction)(int, MPI_Request*, int*, int*, MPI_Status*);
+
+  inline void           some(SomeFunction f, std::vector<request>& requests, std::vector<int>& indices, std::vector<status>& statuses)
+  {
+    static_assert(sizeof(request) == sizeof(MPI_Request), "request must be layout-compatible with MPI_Request");
+    static_assert(sizeof(status)  == sizeof(MPI_Status),  "status must be layout-compatible with MPI_Status");
+
+    indices.resize(requests.size());
+    statuses.resize(requests.size());
+
+    int outcount = 0;
+    if (!requests.empty())
+      f(static_cast<int>(requests.size()), &requests[0].r, &outcount, &indices[0], &statuses[0].s);
+
+    if (outcount == MPI_UNDEFINED)      // no active requests
+      outcount = 0;
+    indices.resize(outcount);
+    statuses.resize(outcount);
+  }
+}
 }
 }
 
@@ -24,3 +56,17 @@ diy::mpi::request::test()
     return s;
   return optional<status>();
 }
+
+void
+diy::mpi::
+test_some(std::vector<request>& requests, std::vector<int>& indices, std::vector<status>& statuses)
+{
+  detail::some(&MPI_Testsome, requests, indices, statuses);
+}
+
+void
+diy::mpi::
+wait_some(std::vector<request>& requests, std::vector<int>& indices, std::vector<status>& statuses)
+{
+  detail::some(&MPI_Waitsome, requests, indices, statuses);
+}
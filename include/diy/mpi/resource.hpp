@@ -0,0 +1,23 @@
+namespace diy
+{
+namespace mpi
+{
+  //! \ingroup MPI
+  //! Memory from `MPI_Alloc_mem()`, which the MPI implementation may have registered with the
+  //! network for faster transfers. Only usable between `MPI_Init()` and `MPI_Finalize()`:
+  //! the buffers allocated from it have to be gone before the environment is. If the memory is allocated
+  //! from several threads (e.g., by a Master with more than one thread), MPI has to be initialized
+  //! with `MPI_THREAD_MULTIPLE` (see mpi::environment).
+  struct alloc_mem_resource: public MemoryResource
+  {
+    void*       allocate(size_t bytes) override
+    {
+      void* p;
+      if (MPI_Alloc_mem(static_cast<MPI_Aint>(bytes), MPI_INFO_NULL, &p) != MPI_SUCCESS)
+        throw std::bad_alloc();
+      return p;
+    }
+    void        deallocate(void* p, size_t) override   { MPI_Free_mem(p); }
+  };
+}
+}
@@ -15,7 +15,8 @@ namespace diy
                           master_(master),
                           incoming_(&master->incoming(gid)),
                           outgoing_(&master->outgoing(gid)),
-                          collectives_(&master->collectives(gid))       {}
+                          outgoing_sizes_(&master->entry(master->outgoing_, master->lid(gid)).sizes),
+                          collectives_(&master->collectives(gid))          {}
 
     int                 gid() const                                     { return gid_; }
 
@@ -24,10 +25,10 @@ namespace diy
     void                enqueue(const BlockID&  to,                                     //!< target block (gid,proc)
                                 const T&        x,                                      //!< data (eg. STL vector)
                                 void (*save)(BinaryBuffer&, const T&) = &::diy::save<T> //!< optional serialization function
-                               ) const
-    { OutgoingQueues& out = *outgoing_; save(out[to], x); }
+                               ) const;
 
     //! Enqueue data whose size is given explicitly by the user, e.g., an array.
+    //! With Master::set_queue_alignment(), the array is aligned in the queue.
     template<class T>
     void                enqueue(const BlockID&  to,                                     //!< target block (gid,proc)
                                 const T*        x,                                      //!< pointer to the data (eg. address of start of vector)
@@ -42,8 +43,7 @@ namespace diy
     void                dequeue(int             from,                                   //!< target block gid
                                 T&              x,                                      //!< data (eg. STL vector)
                                 void (*load)(BinaryBuffer&, T&) = &::diy::load<T>       //!< optional serialization function
-                               ) const
-    { IncomingQueues& in  = *incoming_; load(in[from], x); }
+                               ) const;
 
     //! Dequeue an array of data whose size is given explicitly by the user.
     //! In this case, the user needs to allocate the receive buffer prior to calling dequeue.
@@ -54,6 +54,27 @@ namespace diy
                                 void (*load)(BinaryBuffer&, T&) = &::diy::load<T>       //!< optional serialization function
                                ) const;
 
+    //! Enqueue an array of trivially copyable data, aligned in the queue so that the receiver
+    //! can read it in place with dequeue_view().
+    template<class T>
+    void                enqueue_aligned(const BlockID&  to,                             //!< target block (gid,proc)
+                                        const T*        x,                              //!< pointer to the data
+                                        size_t          n                               //!< size in data elements
+                                       ) const
+    { save_aligned(outgoing(to), x, n); }
+
+    //! Dequeue an array enqueued with enqueue_aligned(), without copying it: the returned span points
+    //! into the incoming queue and is valid until the queue is cleared, in the next exchange.
+    template<class T>
+    Span<T>             dequeue_view(int             from,                              //!< target block gid
+                                     size_t          n                                  //!< size in data elements
+                                    ) const
+    { return load_view<T>(incoming(from), n); }
+
+    //! View of the rest of the queue from block `from` as an array of `T`, without copying it.
+    template<class T>
+    inline Span<T>      incoming_span(int from) const;
+
     template<class T>
     EnqueueIterator<T>  enqueuer(const T& x,
                                  void (*save)(BinaryBuffer&, const T&) = &::diy::save<T>) const
@@ -64,7 +85,7 @@ namespace diy
     inline void         incoming(std::vector<int>& v) const;            // fill v with every gid from which we have a message
 
     OutgoingQueues*     outgoing() const                                { return outgoing_; }
-    MemoryBuffer&       outgoing(const BlockID& to) const               { return (*outgoing_)[to]; }
+    MemoryBuffer&       outgoing(const BlockID& to) const               { return master_->outgoing_queue(*outgoing_, *outgoing_sizes_, to); }
 
 /**
  * \ingroup Communication
@@ -106,6 +127,7 @@ namespace diy
       Master*           master_;
       IncomingQueues*   incoming_;
       OutgoingQueues*   outgoing_;
+      const OutQueueSizes*  outgoing_sizes_;
       CollectivesList*  collectives_;
   };
 
@@ -158,6 +180,21 @@ incoming(std::vector<int>& v) const
     v.push_back(it->first);
 }
 
+template<class T>
+diy::Span<T>
+diy::Master::Proxy::
+incoming_span(int from) const
+{
+  MemoryBuffer& bb    = incoming(from);
+  size_t        start = bb.position + detail::padding(bb.position, std::max(alignof(T), bb.alignment));
+  if (start >= bb.size())
+  {
+    bb.position = bb.size();
+    return Span<T>();
+  }
+  return load_view<T>(bb, (bb.size() - start) / sizeof(T));
+}
+
 template<class T, class Op>
 void
 diy::Master::Proxy::
@@ -194,14 +231,39 @@ scratch(const T& in) const
   collectives_->push_back(Collective(new detail::Scratch<T>(in)));
 }
 
+template<class T>
+void
+diy::Master::Proxy::
+enqueue(const BlockID& to, const T& x,
+        void (*save)(BinaryBuffer&, const T&)) const
+{
+    MemoryBuffer&   bb  = outgoing(to);
+    if (save == (void (*)(BinaryBuffer&, const T&)) &::diy::save<T>)
+        diy::save(bb, x);          // dispatched statically, on MemoryBuffer
+    else
+        save(bb, x);
+}
+
+template<class T>
+void
+diy::Master::Proxy::
+dequeue(int from, T& x,
+        void (*load)(BinaryBuffer&, T&)) const
+{
+    MemoryBuffer&   bb  = incoming(from);
+    if (load == (void (*)(BinaryBuffer&, T&)) &::diy::load<T>)
+        diy::load(bb, x);          // dispatched statically, on MemoryBuffer
+    else
+        load(bb, x);
+}
+
 template<class T>
 void
 diy::Master::Proxy::
 enqueue(const BlockID& to, const T* x, size_t n,
         void (*save)(BinaryBuffer&, const T&)) const
 {
-    OutgoingQueues& out = *outgoing_;
-    BinaryBuffer&   bb  = out[to];
+    MemoryBuffer&   bb  = outgoing(to);
     if (save == (void (*)(BinaryBuffer&, const T&)) &::diy::save<T>)
         diy::save(bb, x, n);       // optimized for unspecialized types
     else
@@ -215,8 +277,7 @@ diy::Master::Proxy::
 dequeue(int from, T* x, size_t n,
         void (*load)(BinaryBuffer&, T&)) const
 {
-    IncomingQueues& in = *incoming_;
-    BinaryBuffer&   bb = in[from];
+    MemoryBuffer&   bb = incoming(from);
     if (load == (void (*)(BinaryBuffer&, T&)) &::diy::load<T>)
         diy::load(bb, x, n);       // optimized for unspecialized types
     else
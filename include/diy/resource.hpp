@@ -0,0 +1,316 @@
+#ifndef DIY_RESOURCE_HPP
+#define DIY_RESOURCE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+#include "thread.hpp"
+
+namespace diy
+{
+  //! Source of the memory behind a MemoryBuffer (after C++17's `std::pmr::memory_resource`).
+  //! The memory has to be suitably aligned for any fundamental type.
+  //! \ingroup Serialization
+  struct MemoryResource
+  {
+    virtual             ~MemoryResource()                           {}
+    virtual void*       allocate(size_t bytes)                      =0;
+    virtual void        deallocate(void* p, size_t bytes)           =0;     //!< `bytes` is what was passed to allocate()
+
+    //! the resource of the default-constructed buffers: `operator new` and `operator delete`
+    inline static MemoryResource*   new_delete();
+  };
+
+  namespace detail
+  {
+    struct NewDeleteResource: public MemoryResource
+    {
+      void*             allocate(size_t bytes) override             { return ::operator new(bytes); }
+      void              deallocate(void* p, size_t) override        { ::operator delete(p); }
+    };
+  }
+
+  //! A standard allocator that draws from a MemoryResource.
+  //! The allocator moves along with the memory, when containers are swapped or assigned,
+  //! so that the memory always goes back to the resource it came from.
+  template<class T>
+  struct ResourceAllocator
+  {
+    typedef             T                   value_type;
+    typedef             std::true_type      propagate_on_container_copy_assignment;
+    typedef             std::true_type      propagate_on_container_move_assignment;
+    typedef             std::true_type      propagate_on_container_swap;
+
+                        ResourceAllocator(MemoryResource* resource = MemoryResource::new_delete()):
+                          resource_(resource)                       {}
+    template<class U>   ResourceAllocator(const ResourceAllocator<U>& other):
+                          resource_(other.resource())               {}
+
+    T*                  allocate(size_t n)                          { return static_cast<T*>(resource_->allocate(n * sizeof(T))); }
+    void                deallocate(T* p, size_t n)                  { resource_->deallocate(p, n * sizeof(T)); }
+
+    //! Elements constructed without a value are default-initialized, so that resize() doesn't
+    //! zero the bytes that are about to be overwritten anyway.
+    template<class U>
+    void                construct(U* p)                             { ::new(static_cast<void*>(p)) U; }
+    template<class U, class... Args>
+    void                construct(U* p, Args&&... args)             { ::new(static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+    MemoryResource*     resource() const                            { return resource_; }
+
+    template<class U>
+    bool                operator==(const ResourceAllocator<U>& other) const     { return resource_ == other.resource(); }
+    template<class U>
+    bool                operator!=(const ResourceAllocator<U>& other) const     { return resource_ != other.resource(); }
+
+    private:
+      MemoryResource*   resource_;
+  };
+
+  //! Serves the allocations of at least `threshold` bytes from whole huge pages (2MB, on Linux, via
+  //! transparent huge pages), which cuts down on TLB misses when walking large buffers;
+  //! the smaller allocations, and everything on other platforms, go to `upstream`.
+  //! \ingroup Serialization
+  class HugePageResource: public MemoryResource
+  {
+    public:
+                        HugePageResource(size_t          threshold = page_size(),
+                                         MemoryResource* upstream  = MemoryResource::new_delete()):
+                          threshold_(threshold), upstream_(upstream)        {}
+
+      static size_t     page_size()                                 { return size_t(2) << 20; }
+
+      inline void*      allocate(size_t bytes) override;
+      inline void       deallocate(void* p, size_t bytes) override;
+
+    private:
+      static size_t     round_up(size_t bytes)                      { return (bytes + page_size() - 1) / page_size() * page_size(); }
+
+    private:
+      size_t            threshold_;
+      MemoryResource*   upstream_;
+  };
+
+  //! Aligns every allocation to `alignment` bytes, a power of 2, by over-allocating from `upstream`
+  //! (which has to align for std::max_align_t, as every resource does) and offsetting into the block.
+  //! \ingroup Serialization
+  class AlignedResource: public MemoryResource
+  {
+    public:
+                        AlignedResource(size_t          alignment,
+                                        MemoryResource* upstream = MemoryResource::new_delete()):
+                          alignment_(std::max(alignment, alignof(std::max_align_t))), upstream_(upstream)  {}
+
+      inline void*      allocate(size_t bytes) override;
+      inline void       deallocate(void* p, size_t bytes) override;
+
+      size_t            alignment() const                           { return alignment_; }
+      MemoryResource*   upstream() const                            { return upstream_; }
+
+    private:
+      size_t            alignment_;
+      MemoryResource*   upstream_;
+  };
+
+  //! Carves the small allocations out of large chunks, to avoid a trip to the system allocator
+  //! for each of the many small queues a round produces. A chunk is reused once every allocation
+  //! in it has been deallocated; the allocations over a quarter of the chunk size go to
+  //! `upstream` directly. Like any resource, it has to outlive the buffers allocated from it.
+  //! Thread-safe.
+  //! \ingroup Serialization
+  class ArenaResource: public MemoryResource
+  {
+    public:
+                        ArenaResource(size_t          chunk_size = size_t(1) << 20,
+                                      MemoryResource* upstream   = MemoryResource::new_delete()):
+                          chunk_size_(chunk_size), upstream_(upstream)    {}
+      inline            ~ArenaResource();
+
+                        ArenaResource(const ArenaResource&)         = delete;
+      ArenaResource&    operator=(const ArenaResource&)             = delete;
+
+      inline void*      allocate(size_t bytes) override;
+      inline void       deallocate(void* p, size_t bytes) override;
+
+      size_t            chunks() const                              { return chunks_; }     //!< number of chunks allocated from upstream
+
+    private:
+      // every allocation is preceded by a header that points to its chunk (or is null, if it came from upstream)
+      struct Chunk
+      {
+        size_t          size;
+        size_t          used;
+        size_t          live;           // number of allocations in the chunk that haven't been deallocated
+      };
+      union Header
+      {
+        Chunk*          chunk;
+        std::max_align_t align;
+      };
+      union ChunkHeader
+      {
+        Chunk           chunk;
+        std::max_align_t align;
+      };
+
+      static size_t     align(size_t bytes)                         { return (bytes + sizeof(Header) - 1) / sizeof(Header) * sizeof(Header); }
+      char*             begin(Chunk* c) const                       { return reinterpret_cast<char*>(reinterpret_cast<ChunkHeader*>(c) + 1); }
+      void              free_chunk(Chunk* c)                        { --chunks_; upstream_->deallocate(reinterpret_cast<ChunkHeader*>(c), sizeof(ChunkHeader) + c->size); }
+
+    private:
+      size_t            chunk_size_;
+      MemoryResource*   upstream_;
+
+      mutex             mutex_;
+      Chunk*            current_ = 0;
+      Chunk*            spare_   = 0;   // an empty chunk, kept to avoid thrashing at the chunk boundary
+      size_t            chunks_  = 0;
+  };
+}
+
+diy::MemoryResource*
+diy::MemoryResource::
+new_delete()
+{
+  static detail::NewDeleteResource resource;
+  return &resource;
+}
+
+void*
+diy::HugePageResource::
+allocate(size_t bytes)
+{
+#if defined(__linux__)
+  if (bytes >= threshold_)
+  {
+    size_t size = round_up(bytes);
+    void* p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+#if defined(MADV_HUGEPAGE)
+    madvise(p, size, MADV_HUGEPAGE);
+#endif
+    return p;
+  }
+#endif
+  return upstream_->allocate(bytes);
+}
+
+void
+diy::HugePageResource::
+deallocate(void* p, size_t bytes)
+{
+#if defined(__linux__)
+  if (bytes >= threshold_)
+  {
+    munmap(p, round_up(bytes));
+    return;
+  }
+#endif
+  upstream_->deallocate(p, bytes);
+}
+
+void*
+diy::AlignedResource::
+allocate(size_t bytes)
+{
+  // upstream aligns for std::max_align_t, so the offset is at least that much, which leaves room to record it
+  char*  p      = static_cast<char*>(upstream_->allocate(bytes + alignment_));
+  size_t offset = alignment_ - reinterpret_cast<std::uintptr_t>(p) % alignment_;
+  char*  q      = p + offset;
+  reinterpret_cast<size_t*>(q)[-1] = offset;
+  return q;
+}
+
+void
+diy::AlignedResource::
+deallocate(void* p, size_t bytes)
+{
+  char* q = static_cast<char*>(p);
+  upstream_->deallocate(q - reinterpret_cast<size_t*>(q)[-1], bytes + alignment_);
+}
+
+diy::ArenaResource::
+~ArenaResource()
+{
+  // the chunks that are still in use are leaked, rather than pulled from under their buffers
+  if (spare_)
+    free_chunk(spare_);
+  if (current_ && current_->live == 0)
+    free_chunk(current_);
+}
+
+void*
+diy::ArenaResource::
+allocate(size_t bytes)
+{
+  size_t size = sizeof(Header) + align(bytes);
+  if (size > chunk_size_ / 4)
+  {
+    Header* h = static_cast<Header*>(upstream_->allocate(size));
+    h->chunk = 0;
+    return h + 1;
+  }
+
+  lock_guard<mutex> lock(mutex_);
+  Chunk* c = current_;
+  if (!c || c->used + size > c->size)
+  {
+    if (c && c->live == 0)
+      c->used = 0;                  // nothing left in the current chunk, start over
+    else
+    {
+      if (spare_)
+      {
+        c      = spare_;
+        spare_ = 0;
+      } else
+      {
+        c = &static_cast<ChunkHeader*>(upstream_->allocate(sizeof(ChunkHeader) + chunk_size_))->chunk;
+        c->size = chunk_size_;
+        ++chunks_;
+      }
+      c->used  = 0;
+      c->live  = 0;
+      current_ = c;
+    }
+  }
+
+  Header* h = reinterpret_cast<Header*>(begin(c) + c->used);
+  h->chunk = c;
+  c->used += size;
+  ++c->live;
+  return h + 1;
+}
+
+void
+diy::ArenaResource::
+deallocate(void* p, size_t bytes)
+{
+  Header* h = static_cast<Header*>(p) - 1;
+  Chunk*  c = h->chunk;
+  if (!c)
+  {
+    upstream_->deallocate(h, sizeof(Header) + align(bytes));
+    return;
+  }
+
+  lock_guard<mutex> lock(mutex_);
+  if (--c->live != 0 || c == current_)
+    return;
+
+  if (!spare_)
+    spare_ = c;
+  else
+    free_chunk(c);
+}
+
+#endif
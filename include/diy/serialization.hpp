@@ -7,11 +7,18 @@
 #include <set>
 #include <string>
 #include <fstream>
+#include <algorithm>
 
 #include <tuple>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <type_traits>              // this is used for a safety check for default serialization
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#include "resource.hpp"
 
 namespace diy
 {
@@ -21,25 +28,52 @@ namespace diy
     virtual void        save_binary(const char* x, size_t count)    =0;   //!< copy `count` bytes from `x` into the buffer
     virtual void        load_binary(char* x, size_t count)          =0;   //!< copy `count` bytes into `x` from the buffer
     virtual void        load_binary_back(char* x, size_t count)     =0;   //!< copy `count` bytes into `x` from the back of the buffer
+
+    //! Reserve `count` bytes for writing in place, instead of copying them in with save_binary().
+    //! Returns 0 if the buffer doesn't support it.
+    virtual char*       grow(size_t)                                { return 0; }
+    //! Skip over the next `count` bytes, returning their address, so they can be read in place.
+    //! Returns 0 (and skips nothing) if the buffer doesn't support it.
+    virtual const char* advance(size_t)                             { return 0; }
+
+    //! In the aligned framing mode, pad the buffer, or skip the padding, so that the array about to be
+    //! saved, or loaded, starts at a multiple of its natural alignment or of the configured one,
+    //! whichever is larger. The default, packed, mode has no padding.
+    virtual void        save_padding(size_t)                        {}
+    virtual void        load_padding(size_t)                        {}
   };
 
-  struct MemoryBuffer: public BinaryBuffer
+  //! Final, so that the calls through a `MemoryBuffer&` (see the `diy::save()` and `diy::load()` overloads for it)
+  //! are dispatched statically and can be inlined.
+  struct MemoryBuffer final: public BinaryBuffer
   {
+    //! the storage; not a plain `std::vector<char>`, so that its memory can come from any MemoryResource
+    typedef             std::vector<char, ResourceAllocator<char>>  Buffer;
+
                         MemoryBuffer(size_t position_ = 0):
                           position(position_)                       {}
 
     virtual inline void save_binary(const char* x, size_t count) override;   //!< copy `count` bytes from `x` into the buffer
     virtual inline void load_binary(char* x, size_t count) override;         //!< copy `count` bytes into `x` from the buffer
     virtual inline void load_binary_back(char* x, size_t count) override;    //!< copy `count` bytes into `x` from the back of the buffer
+    virtual inline char* grow(size_t count) override;                        //!< `count` writable bytes at the current position; the new ones are uninitialized
+    virtual const char* advance(size_t count) override                      { const char* x = buffer.data() + position; position += count; return x; }
+    virtual inline void save_padding(size_t natural) override;
+    virtual inline void load_padding(size_t natural) override;
 
     void                clear()                                     { buffer.clear(); reset(); }
-    void                wipe()                                      { std::vector<char>().swap(buffer); reset(); }
+    void                wipe()                                      { Buffer(buffer.get_allocator()).swap(buffer); reset(); }
     void                reset()                                     { position = 0; }
     void                skip(size_t s)                              { position += s; }
-    void                swap(MemoryBuffer& o)                       { std::swap(position, o.position); buffer.swap(o.buffer); }
+    void                swap(MemoryBuffer& o)                       { std::swap(position, o.position); buffer.swap(o.buffer); std::swap(alignment, o.alignment); }
     bool                empty() const                               { return buffer.empty(); }
     size_t              size() const                                { return buffer.size(); }
     void                reserve(size_t s)                           { buffer.reserve(s); }
+
+    //! the resource that the buffer's memory comes from (MemoryResource::new_delete(), unless set otherwise)
+    MemoryResource*     resource() const                            { return buffer.get_allocator().resource(); }
+    //! move the contents of the buffer into memory from `r`
+    void                set_resource(MemoryResource* r)             { if (r != resource()) { Buffer b(buffer.begin(), buffer.end(), r); buffer.swap(b); } }
                         operator bool() const                       { return position < buffer.size(); }
 
     //! copy a memory buffer from one buffer to another, bypassing making a temporary copy first
@@ -60,7 +94,9 @@ namespace diy
     }
 
     size_t              position;
-    std::vector<char>   buffer;
+    Buffer              buffer;
+    size_t              alignment = 0;  //!< aligned framing: arrays start at a multiple of this many bytes (or more, see save_padding()); 0 packs them;
+                                        //!< for the arrays to be aligned in memory (see load_view()), so has to be the storage (see AlignedResource)
   };
 
   namespace detail
@@ -93,8 +129,10 @@ namespace diy
     static_assert(std::is_trivially_copyable<T>::value, "Default serialization works only for trivially copyable types");
 #endif
 
-    static void         save(BinaryBuffer& bb, const T& x)          { bb.save_binary((const char*)  &x, sizeof(T)); }
-    static void         load(BinaryBuffer& bb, T& x)                { bb.load_binary((char*)        &x, sizeof(T)); }
+    template<class Buffer>
+    static void         save(Buffer& bb, const T& x)                { bb.save_binary((const char*)  &x, sizeof(T)); }
+    template<class Buffer>
+    static void         load(Buffer& bb, T& x)                      { bb.load_binary((char*)        &x, sizeof(T)); }
   };
 
   //! Saves `x` to `bb` by calling `diy::Serialization<T>::save(bb,x)`.
@@ -105,6 +143,48 @@ namespace diy
   template<class T>
   void                  load(BinaryBuffer& bb, T& x)                { Serialization<T>::load(bb, x); }
 
+  namespace detail
+  {
+    // Whether a user-provided overload of diy::save(BinaryBuffer&, const T&) (or of load()) exists:
+    // the probes below tie with the generic templates above, so the call resolves only if something
+    // more specific, i.e., the user's overload, is there to win.
+    namespace probe
+    {
+      struct Generic {};
+      template<class T> Generic   save(BinaryBuffer& bb, const T& x);
+      template<class T> Generic   load(BinaryBuffer& bb, T& x);
+
+      template<class T, class = void>
+      struct has_save: std::false_type {};
+      template<class T>
+      struct has_save<T, decltype(void(save(std::declval<BinaryBuffer&>(), std::declval<const T&>())))>: std::true_type {};
+
+      template<class T, class = void>
+      struct has_load: std::false_type {};
+      template<class T>
+      struct has_load<T, decltype(void(load(std::declval<BinaryBuffer&>(), std::declval<T&>())))>: std::true_type {};
+    }
+
+    // the overloads below apply to a MemoryBuffer, unless the user overloaded save() or load() for T
+    template<class Buffer, class T>     struct memory_buffer_save:                  std::false_type {};
+    template<class T>                   struct memory_buffer_save<MemoryBuffer, T>: std::integral_constant<bool, !probe::has_save<T>::value> {};
+    template<class Buffer, class T>     struct memory_buffer_load:                  std::false_type {};
+    template<class T>                   struct memory_buffer_load<MemoryBuffer, T>: std::integral_constant<bool, !probe::has_load<T>::value> {};
+  }
+
+  //! Same as above, without the virtual calls: specializations of `diy::Serialization<T>`, whose `save()`
+  //! and `load()` are templated on the type of the buffer (like the ones for the STL containers),
+  //! get the `MemoryBuffer` itself, and the compiler can inline its functions into them.
+  //! Only for a `MemoryBuffer` (the `Buffer` parameter just defers the check), and only if there is no
+  //! overload of `diy::save(BinaryBuffer&, const T&)` for `T`, which then takes precedence, as it would without these.
+  template<class T, class Buffer>
+  typename std::enable_if<detail::memory_buffer_save<Buffer, T>::value>::type
+                        save(Buffer& bb, const T& x)                { Serialization<T>::save(bb, x); }
+
+  template<class T, class Buffer>
+  typename std::enable_if<detail::memory_buffer_load<Buffer, T>::value>::type
+                        load(Buffer& bb, T& x)                      { Serialization<T>::load(bb, x); }
+
   //! Optimization for arrays. If `diy::Serialization` is not specialized for `T`,
   //! the array will be copied all at once. Otherwise, it's copied element by element.
   template<class T>
@@ -115,10 +195,68 @@ namespace diy
   template<class T>
   void                  load(BinaryBuffer& bb, T* x, size_t n);
 
+  template<class T>
+  void                  save(MemoryBuffer& bb, const T* x, size_t n);
+
+  template<class T>
+  void                  load(MemoryBuffer& bb, T* x, size_t n);
+
+  //! Writes values into space reserved in a MemoryBuffer all at once, without the capacity check
+  //! that save_binary() makes for every value. Exactly `count` bytes have to be written.
+  //! Values are copied as they are, so only the types with default serialization qualify.
+  class UncheckedWriter
+  {
+    public:
+                        UncheckedWriter(MemoryBuffer& bb, size_t count):
+                          x_(bb.grow(count)), end_(x_ + count)      {}
+
+      template<class T>
+      void              save(const T& x)                            { assert(sizeof(T) <= remaining()); std::memcpy(x_, &x, sizeof(T)); x_ += sizeof(T); }
+      template<class T>
+      void              save(const T* x, size_t n)                  { assert(sizeof(T)*n <= remaining()); std::memcpy(x_, x, sizeof(T)*n); x_ += sizeof(T)*n; }
+
+      size_t            remaining() const                           { return end_ - x_; }
+
+    private:
+      char*             x_;
+      char*             end_;
+  };
+
   //! Supports only binary data copying (meant for simple footers).
   template<class T>
   void                  load_back(BinaryBuffer& bb, T& x)           { bb.load_binary_back((char*) &x, sizeof(T)); }
 
+  //! A read-only view of `n` consecutive values of type `T` stored elsewhere, e.g., in a MemoryBuffer.
+  template<class T>
+  struct Span
+  {
+    typedef             const T*                    iterator;
+
+                        Span(const T* data = 0, size_t size = 0):
+                          data_(data), size_(size)                  {}
+
+    const T*            data() const                                { return data_; }
+    size_t              size() const                                { return size_; }
+    bool                empty() const                               { return size_ == 0; }
+    iterator            begin() const                               { return data_; }
+    iterator            end() const                                 { return data_ + size_; }
+    const T&            operator[](size_t i) const                  { return data_[i]; }
+
+    private:
+      const T*          data_;
+      size_t            size_;
+  };
+
+  //! Saves the array padded to start at a multiple of `alignof(T)` bytes into the buffer,
+  //! so that load_view() can read it in place. Only for the types with default serialization.
+  template<class T>
+  void                  save_aligned(MemoryBuffer& bb, const T* x, size_t n);
+
+  //! Returns a view of the next `n` values, saved with save_aligned(), without copying them out of the buffer.
+  //! The view is valid until the buffer is modified.
+  template<class T>
+  Span<T>               load_view(MemoryBuffer& bb, size_t n);
+
   //@}
 
 
@@ -137,42 +275,89 @@ namespace diy
     };
   }
 
+  namespace detail
+  {
+    // bytes needed to take `position` to the next multiple of `alignment`
+    inline size_t       padding(size_t position, size_t alignment)  { return (alignment - position % alignment) % alignment; }
+
+    template<class Buffer, class T>
+    void                save_array(Buffer& bb, const T* x, size_t n)
+    {
+      if (!is_default< Serialization<T> >::value)
+        for (size_t i = 0; i < n; ++i)
+          diy::save(bb, x[i]);
+      else        // if Serialization is not specialized for U, just save the binary data
+      {
+        if (n)
+          bb.save_padding(alignof(T));
+        bb.save_binary((const char*) &x[0], sizeof(T)*n);
+      }
+    }
+
+    template<class Buffer, class T>
+    void                load_array(Buffer& bb, T* x, size_t n)
+    {
+      if (!is_default< Serialization<T> >::value)
+        for (size_t i = 0; i < n; ++i)
+          diy::load(bb, x[i]);
+      else      // if Serialization is not specialized for U, just load the binary data
+      {
+        if (n)
+          bb.load_padding(alignof(T));
+        bb.load_binary((char*) &x[0], sizeof(T)*n);
+      }
+    }
+  }
+
+  template<class T>
+  void                  save(BinaryBuffer& bb, const T* x, size_t n)  { detail::save_array(bb, x, n); }
+
+  template<class T>
+  void                  load(BinaryBuffer& bb, T* x, size_t n)        { detail::load_array(bb, x, n); }
+
+  template<class T>
+  void                  save(MemoryBuffer& bb, const T* x, size_t n)  { detail::save_array(bb, x, n); }
+
+  template<class T>
+  void                  load(MemoryBuffer& bb, T* x, size_t n)        { detail::load_array(bb, x, n); }
+
   template<class T>
-  void                  save(BinaryBuffer& bb, const T* x, size_t n)
+  void                  save_aligned(MemoryBuffer& bb, const T* x, size_t n)
   {
-    if (!detail::is_default< Serialization<T> >::value)
-      for (size_t i = 0; i < n; ++i)
-        diy::save(bb, x[i]);
-    else        // if Serialization is not specialized for U, just save the binary data
-      bb.save_binary((const char*) &x[0], sizeof(T)*n);
+    size_t pad = detail::padding(bb.position, std::max(alignof(T), bb.alignment));
+    if (pad)
+      std::memset(bb.grow(pad), 0, pad);
+    bb.save_binary((const char*) x, sizeof(T)*n);
   }
 
   template<class T>
-  void                  load(BinaryBuffer& bb, T* x, size_t n)
+  Span<T>               load_view(MemoryBuffer& bb, size_t n)
   {
-    if (!detail::is_default< Serialization<T> >::value)
-      for (size_t i = 0; i < n; ++i)
-        diy::load(bb, x[i]);
-    else      // if Serialization is not specialized for U, just load the binary data
-      bb.load_binary((char*) &x[0], sizeof(T)*n);
+    bb.skip(detail::padding(bb.position, std::max(alignof(T), bb.alignment)));
+    const char* x = bb.advance(sizeof(T)*n);
+    assert(reinterpret_cast<std::uintptr_t>(x) % std::max(alignof(T), bb.alignment) == 0);   // the storage has to be aligned as much as the offsets
+    return Span<T>(reinterpret_cast<const T*>(x), n);
   }
 
 
-  // save/load for MemoryBuffer
+  // save/load for MemoryBuffer; the bytes follow the size directly, without
+  // alignment padding, so that MemoryBuffer::copy() and skip() stay valid
   template<>
   struct Serialization< MemoryBuffer >
   {
     static void         save(BinaryBuffer& bb, const MemoryBuffer& x)
     {
       diy::save(bb, x.position);
-      diy::save(bb, &x.buffer[0], x.position);
+      if (x.position)
+        bb.save_binary(&x.buffer[0], x.position);
     }
 
     static void         load(BinaryBuffer& bb, MemoryBuffer& x)
     {
       diy::load(bb, x.position);
       x.buffer.resize(x.position);
-      diy::load(bb, &x.buffer[0], x.position);
+      if (x.position)
+        bb.load_binary(&x.buffer[0], x.position);
     }
   };
 
@@ -182,17 +367,37 @@ namespace diy
   {
     typedef             std::vector<U>          Vector;
 
-    static void         save(BinaryBuffer& bb, const Vector& v)
+    template<class Buffer>
+    static void         save(Buffer& bb, const Vector& v)
     {
       size_t s = v.size();
       diy::save(bb, s);
       diy::save(bb, &v[0], v.size());
     }
 
-    static void         load(BinaryBuffer& bb, Vector& v)
+    template<class Buffer>
+    static void         load(Buffer& bb, Vector& v)
     {
       size_t s;
       diy::load(bb, s);
+
+      // copy the elements straight out of the buffer, rather than over the zeros of resize()
+      if (detail::is_default< Serialization<U> >::value && s)
+      {
+        bb.load_padding(alignof(U));            // idempotent, so the fallback below can skip it again
+        const char* x = bb.advance(sizeof(U)*s);
+        if (x && reinterpret_cast<std::uintptr_t>(x) % alignof(U) == 0)
+        {
+          v.assign(reinterpret_cast<const U*>(x), reinterpret_cast<const U*>(x) + s);
+          return;
+        } else if (x)
+        {
+          v.resize(s);
+          std::memcpy((void*) v.data(), x, sizeof(U)*s);
+          return;
+        }
+      }
+
       v.resize(s);
       diy::load(bb, &v[0], s);
     }
@@ -225,17 +430,29 @@ namespace diy
   {
     typedef             std::string             String;
 
-    static void         save(BinaryBuffer& bb, const String& s)
+    template<class Buffer>
+    static void         save(Buffer& bb, const String& s)
     {
       size_t sz = s.size();
       diy::save(bb, sz);
       diy::save(bb, s.c_str(), sz);
     }
 
-    static void         load(BinaryBuffer& bb, String& s)
+    template<class Buffer>
+    static void         load(Buffer& bb, String& s)
     {
       size_t sz;
       diy::load(bb, sz);
+
+      if (sz)
+        bb.load_padding(alignof(char));         // the characters are saved as an array
+      const char* x = bb.advance(sz);
+      if (x)
+      {
+        s.assign(x, sz);
+        return;
+      }
+
       s.resize(sz);
       for (size_t i = 0; i < sz; ++i)
       {
@@ -252,44 +469,128 @@ namespace diy
   {
     typedef             std::pair<X,Y>          Pair;
 
-    static void         save(BinaryBuffer& bb, const Pair& p)
+    template<class Buffer>
+    static void         save(Buffer& bb, const Pair& p)
     {
       diy::save(bb, p.first);
       diy::save(bb, p.second);
     }
 
-    static void         load(BinaryBuffer& bb, Pair& p)
+    template<class Buffer>
+    static void         load(Buffer& bb, Pair& p)
     {
       diy::load(bb, p.first);
       diy::load(bb, p.second);
     }
   };
 
+  namespace detail
+  {
+    // The associative containers of the types with default serialization are saved as arrays,
+    // first all the keys, then all the values, which are copied all at once, like std::vector's.
+    // The others are saved element by element (pair by pair, for the maps), as they always were.
+
+    template<class T>
+    struct is_bulk:
+      std::integral_constant<bool, is_default< Serialization<T> >::value>             {};
+
+    template<class K, class V>
+    struct is_bulk< std::pair<K,V> >:
+      std::integral_constant<bool, is_bulk<K>::value && is_bulk<V>::value>            {};
+
+    template<class Buffer, class C>
+    void                save_elements(Buffer& bb, const C& c, std::false_type)
+    {
+      for (typename C::const_iterator it = c.begin(); it != c.end(); ++it)
+        diy::save(bb, *it);
+    }
+
+    // elements are copied into an array in one pass over the container, then saved all at once
+    template<class Buffer, class Set>
+    void                save_elements(Buffer& bb, const Set& m, std::true_type)
+    {
+      typedef typename Set::value_type  T;
+
+      std::unique_ptr<T[]> elements(new T[m.size()]);
+      std::copy(m.begin(), m.end(), elements.get());
+      diy::save(bb, elements.get(), m.size());
+    }
+
+    template<class Buffer, class K, class V, class Map>
+    void                save_pairs(Buffer& bb, const Map& m)
+    {
+      size_t s = m.size();
+      std::unique_ptr<K[]> keys(new K[s]);
+      std::unique_ptr<V[]> values(new V[s]);
+      size_t i = 0;
+      for (typename Map::const_iterator it = m.begin(); it != m.end(); ++it, ++i)
+      {
+        keys[i]   = it->first;
+        values[i] = it->second;
+      }
+      diy::save(bb, keys.get(),   s);
+      diy::save(bb, values.get(), s);
+    }
+
+    // calls `insert(k,v)` for each of the `s` pairs saved by save_pairs()
+    template<class K, class V, class Buffer, class Insert>
+    void                load_pairs(Buffer& bb, size_t s, Insert insert)
+    {
+      std::unique_ptr<K[]> keys(new K[s]);
+      std::unique_ptr<V[]> values(new V[s]);
+      diy::load(bb, keys.get(),   s);
+      diy::load(bb, values.get(), s);
+      for (size_t i = 0; i < s; ++i)
+        insert(keys[i], values[i]);
+    }
+  }
+
   // save/load for std::map<K,V>
   template<class K, class V>
   struct Serialization< std::map<K,V> >
   {
     typedef             std::map<K,V>           Map;
+    typedef             detail::is_bulk< std::pair<K,V> >   Bulk;
 
-    static void         save(BinaryBuffer& bb, const Map& m)
+    template<class Buffer>
+    static void         save(Buffer& bb, const Map& m)
     {
       size_t s = m.size();
       diy::save(bb, s);
-      for (typename std::map<K,V>::const_iterator it = m.begin(); it != m.end(); ++it)
-        diy::save(bb, *it);
+      save(bb, m, Bulk());
     }
 
-    static void         load(BinaryBuffer& bb, Map& m)
+    template<class Buffer>
+    static void         load(Buffer& bb, Map& m)
     {
       size_t s;
       diy::load(bb, s);
-      for (size_t i = 0; i < s; ++i)
+      load(bb, m, s, Bulk());
+    }
+
+    private:
+      template<class Buffer>
+      static void       save(Buffer& bb, const Map& m, std::false_type)     { detail::save_elements(bb, m, std::false_type()); }
+      template<class Buffer>
+      static void       save(Buffer& bb, const Map& m, std::true_type)      { detail::save_pairs<Buffer,K,V>(bb, m); }
+
+      template<class Buffer>
+      static void       load(Buffer& bb, Map& m, size_t s, std::false_type)
       {
-        K k;
-        diy::load(bb, k);
-        diy::load(bb, m[k]);
+        for (size_t i = 0; i < s; ++i)
+        {
+          K k;
+          diy::load(bb, k);
+          diy::load(bb, m[k]);
+        }
+      }
+
+      template<class Buffer>
+      static void       load(Buffer& bb, Map& m, size_t s, std::true_type)
+      {
+        // the keys come sorted, so inserting at the end takes constant time; like m[k], replaces the existing values
+        detail::load_pairs<K,V>(bb, s, [&m](const K& k, const V& v) { m.emplace_hint(m.end(), k, v)->second = v; });
       }
-    }
   };
 
   // save/load for std::set<T>
@@ -298,25 +599,42 @@ namespace diy
   {
     typedef             std::set<T>             Set;
 
-    static void         save(BinaryBuffer& bb, const Set& m)
+    template<class Buffer>
+    static void         save(Buffer& bb, const Set& m)
     {
       size_t s = m.size();
       diy::save(bb, s);
-      for (typename std::set<T>::const_iterator it = m.begin(); it != m.end(); ++it)
-        diy::save(bb, *it);
+      detail::save_elements(bb, m, detail::is_bulk<T>());
     }
 
-    static void         load(BinaryBuffer& bb, Set& m)
+    template<class Buffer>
+    static void         load(Buffer& bb, Set& m)
     {
       size_t s;
       diy::load(bb, s);
-      for (size_t i = 0; i < s; ++i)
+      load(bb, m, s, detail::is_bulk<T>());
+    }
+
+    private:
+      template<class Buffer>
+      static void       load(Buffer& bb, Set& m, size_t s, std::false_type)
       {
-        T p;
-        diy::load(bb, p);
-        m.insert(p);
+        for (size_t i = 0; i < s; ++i)
+        {
+          T p;
+          diy::load(bb, p);
+          m.insert(p);
+        }
+      }
+
+      template<class Buffer>
+      static void       load(Buffer& bb, Set& m, size_t s, std::true_type)
+      {
+        std::unique_ptr<T[]> elements(new T[s]);
+        diy::load(bb, elements.get(), s);
+        for (size_t i = 0; i < s; ++i)
+          m.insert(m.end(), elements[i]);       // sorted, so constant time
       }
-    }
   };
 
   // save/load for std::unordered_map<K,V,H,E,A>
@@ -324,26 +642,48 @@ namespace diy
   struct Serialization< std::unordered_map<K,V,H,E,A> >
   {
     typedef             std::unordered_map<K,V,H,E,A>   Map;
+    typedef             detail::is_bulk< std::pair<K,V> >   Bulk;
 
-    static void         save(BinaryBuffer& bb, const Map& m)
+    template<class Buffer>
+    static void         save(Buffer& bb, const Map& m)
     {
       size_t s = m.size();
       diy::save(bb, s);
-      for (auto& x : m)
-        diy::save(bb, x);
+      save(bb, m, Bulk());
     }
 
-    static void         load(BinaryBuffer& bb, Map& m)
+    template<class Buffer>
+    static void         load(Buffer& bb, Map& m)
     {
       size_t s;
       diy::load(bb, s);
-      for (size_t i = 0; i < s; ++i)
+      load(bb, m, s, Bulk());
+    }
+
+    private:
+      template<class Buffer>
+      static void       save(Buffer& bb, const Map& m, std::false_type)     { detail::save_elements(bb, m, std::false_type()); }
+      template<class Buffer>
+      static void       save(Buffer& bb, const Map& m, std::true_type)      { detail::save_pairs<Buffer,K,V>(bb, m); }
+
+      template<class Buffer>
+      static void       load(Buffer& bb, Map& m, size_t s, std::false_type)
       {
-        std::pair<K,V> p;
-        diy::load(bb, p);
-        m.emplace(std::move(p));
+        for (size_t i = 0; i < s; ++i)
+        {
+          std::pair<K,V> p;
+          diy::load(bb, p);
+          m.emplace(std::move(p));
+        }
+      }
+
+      template<class Buffer>
+      static void       load(Buffer& bb, Map& m, size_t s, std::true_type)
+      {
+        // like emplace() above, keeps the existing values
+        m.reserve(m.size() + s);
+        detail::load_pairs<K,V>(bb, s, [&m](const K& k, const V& v) { m.emplace(k, v); });
       }
-    }
   };
 
   // save/load for std::unordered_set<T,H,E,A>
@@ -352,25 +692,42 @@ namespace diy
   {
     typedef             std::unordered_set<T,H,E,A>     Set;
 
-    static void         save(BinaryBuffer& bb, const Set& m)
+    template<class Buffer>
+    static void         save(Buffer& bb, const Set& m)
     {
       size_t s = m.size();
       diy::save(bb, s);
-      for (auto& x : m)
-        diy::save(bb, x);
+      detail::save_elements(bb, m, detail::is_bulk<T>());
     }
 
-    static void         load(BinaryBuffer& bb, Set& m)
+    template<class Buffer>
+    static void         load(Buffer& bb, Set& m)
     {
       size_t s;
       diy::load(bb, s);
-      for (size_t i = 0; i < s; ++i)
+      load(bb, m, s, detail::is_bulk<T>());
+    }
+
+    private:
+      template<class Buffer>
+      static void       load(Buffer& bb, Set& m, size_t s, std::false_type)
       {
-        T p;
-        diy::load(bb, p);
-        m.emplace(std::move(p));
+        for (size_t i = 0; i < s; ++i)
+        {
+          T p;
+          diy::load(bb, p);
+          m.emplace(std::move(p));
+        }
+      }
+
+      template<class Buffer>
+      static void       load(Buffer& bb, Set& m, size_t s, std::true_type)
+      {
+        std::unique_ptr<T[]> elements(new T[s]);
+        diy::load(bb, elements.get(), s);
+        m.reserve(m.size() + s);
+        m.insert(elements.get(), elements.get() + s);
       }
-    }
   };
 
   // save/load for std::tuple<...>
@@ -412,14 +769,45 @@ void
 diy::MemoryBuffer::
 save_binary(const char* x, size_t count)
 {
-  if (position + count > buffer.capacity())
-    buffer.reserve((position + count) * growth_multiplier());           // if we have to grow, grow geometrically
+  char* to = grow(count);
+  if (count)
+    std::memcpy(to, x, count);
+}
 
+void
+diy::MemoryBuffer::
+save_padding(size_t natural)
+{
+  if (!alignment)
+    return;
+
+  size_t pad = detail::padding(position, std::max(natural, alignment));
+  if (pad)
+    std::memset(grow(pad), 0, pad);
+}
+
+void
+diy::MemoryBuffer::
+load_padding(size_t natural)
+{
+  if (alignment)
+    position += detail::padding(position, std::max(natural, alignment));
+}
+
+char*
+diy::MemoryBuffer::
+grow(size_t count)
+{
   if (position + count > buffer.size())
-    buffer.resize(position + count);
+  {
+    if (position + count > buffer.capacity())
+      buffer.reserve((position + count) * growth_multiplier());         // if we have to grow, grow geometrically
+    buffer.resize(position + count);                                    // doesn't initialize the new bytes (see ResourceAllocator)
+  }
 
-  std::copy(x, x + count, &buffer[position]);
+  char* x = buffer.data() + position;
   position += count;
+  return x;
 }
 
 void
@@ -447,10 +835,8 @@ copy(MemoryBuffer& from, MemoryBuffer& to)
   from.position -= sizeof(size_t);
 
   size_t total = sizeof(size_t) + sz;
-  to.buffer.resize(to.position + total);
-  std::copy(&from.buffer[from.position], &from.buffer[from.position + total], &to.buffer[to.position]);
-  to.position += total;
-  from.position += total;
+  const char* x = from.advance(total);
+  std::copy(x, x + total, to.grow(total));
 }
 
 #endif
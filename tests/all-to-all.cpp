@@ -0,0 +1,153 @@
+//
+// All-to-all redistributes points into the blocks whose bounds contain them. With k smaller than
+// the number of blocks, the intermediate rounds forward the queues through MemoryBuffer::copy(),
+// which is what the aligned runs (-A) exercise.
+//
+
+#include <cmath>
+#include <vector>
+
+#include <diy/master.hpp>
+#include <diy/reduce-operations.hpp>
+#include <diy/decomposition.hpp>
+#include <diy/assigner.hpp>
+
+#define CATCH_CONFIG_RUNNER
+#include "catch.hpp"
+
+#include "opts.h"
+#include "point.h"
+
+typedef     diy::ContinuousBounds               Bounds;
+typedef     diy::RegularContinuousLink          RCLink;
+typedef     diy::RegularDecomposer<Bounds>      Decomposer;
+
+static const unsigned DIM = 3;
+typedef     PointBlock<DIM>                     Block;
+typedef     AddPointBlock<DIM>                  AddBlock;
+
+struct Redistribute
+{
+       Redistribute(const Decomposer& decomposer_):
+           decomposer(decomposer_)              {}
+
+  void operator()(Block* b, const diy::ReduceProxy& rp) const
+  {
+      if (rp.in_link().size() == 0)
+      {
+          // sort the points by destination and send them as vectors
+          std::vector< std::vector<Block::Point> > out_points(rp.out_link().size());
+          for (size_t i = 0; i < b->points.size(); ++i)
+              out_points[decomposer.point_to_gid(b->points[i])].push_back(b->points[i]);
+
+          for (int i = 0; i < rp.out_link().size(); ++i)
+              if (!out_points[i].empty())
+                  rp.enqueue(rp.out_link().target(i), out_points[i]);
+
+          b->points.clear();
+      } else
+      {
+          b->box = b->bounds;
+          for (int i = 0; i < rp.in_link().size(); ++i)
+          {
+              int gid = rp.in_link().target(i).gid;
+              while (rp.incoming(gid))
+              {
+                  std::vector<Block::Point> in_points;
+                  rp.dequeue(gid, in_points);
+                  b->points.insert(b->points.end(), in_points.begin(), in_points.end());
+              }
+          }
+      }
+  }
+
+  const Decomposer& decomposer;
+};
+
+struct AllToAllFixture
+{
+    static int          nblocks;
+    static size_t       num_points;
+    static int          threads;
+    static int          k;
+    static size_t       alignment;
+
+    diy::mpi::communicator    world;
+};
+
+int         AllToAllFixture::nblocks     = 0;
+size_t      AllToAllFixture::num_points  = 100;            // points per block
+int         AllToAllFixture::threads     = 1;
+int         AllToAllFixture::k           = 2;              // radix for k-ary reduction
+size_t      AllToAllFixture::alignment   = 0;              // queue alignment
+
+TEST_CASE_METHOD(AllToAllFixture, "points end up in their blocks", "[all-to-all]")
+{
+    Bounds domain;
+    domain.min[0] = domain.min[1] = domain.min[2] = 0;
+    domain.max[0] = domain.max[1] = domain.max[2] = 100.;
+
+    diy::Master               master(world,
+                                     threads,
+                                     -1,
+                                     &Block::create,
+                                     &Block::destroy);
+    master.set_queue_alignment(alignment);
+
+    diy::ContiguousAssigner   assigner(world.size(), nblocks);
+    AddBlock                  create(master, num_points);
+
+    Decomposer    decomposer(DIM, domain, nblocks);
+    decomposer.decompose(world.rank(), assigner, create);
+    diy::all_to_all(master, assigner, Redistribute(decomposer), k);
+
+    master.set_threads(1);        // catch.hpp isn't thread-safe
+
+    size_t local = 0;
+    master.foreach([&local](Block* b, const diy::Master::ProxyWithLink&)
+    {
+        local += b->points.size();
+        for (size_t i = 0; i < b->points.size(); ++i)
+            for (unsigned j = 0; j < DIM; ++j)
+            {
+                CHECK(b->points[i][j] >= b->box.min[j]);
+                CHECK(b->points[i][j] <= b->box.max[j]);
+            }
+    });
+
+    size_t total;
+    diy::mpi::all_reduce(world, local, total, std::plus<size_t>());
+    REQUIRE(total == num_points * nblocks);
+}
+
+int main(int argc, char* argv[])
+{
+    diy::mpi::environment     env(argc, argv);
+    diy::mpi::communicator    world;
+
+    Catch::Session session;
+
+    AllToAllFixture::nblocks = world.size();
+
+    using namespace opts;
+    Options ops(argc, argv);
+    ops
+        >> Option('n', "number",  AllToAllFixture::num_points,     "number of points per block")
+        >> Option('k', "k",       AllToAllFixture::k,              "use k-ary all-to-all")
+        >> Option('b', "blocks",  AllToAllFixture::nblocks,        "number of blocks")
+        >> Option('t', "thread",  AllToAllFixture::threads,        "number of threads")
+        >> Option('A', "align",   AllToAllFixture::alignment,      "queue alignment")
+        ;
+    if (ops >> Present('h', "help", "show help"))
+    {
+        if (world.rank() == 0)
+        {
+            std::cout << "Usage: " << argv[0] << " [OPTIONS]\n";
+            std::cout << "Redistributes random points into the blocks that contain them using all-to-all.\n";
+            std::cout << ops;
+        }
+        return 1;
+    }
+
+    return session.run();
+}
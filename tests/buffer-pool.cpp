@@ -0,0 +1,96 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <diy/detail/buffer-pool.hpp>
+
+typedef     diy::detail::BufferPool     BufferPool;
+typedef     BufferPool::Buffer          Buffer;
+
+TEST_CASE("BufferPool", "[buffer-pool]")
+{
+    BufferPool pool;
+
+    SECTION("acquire rounds up to the size class")
+    {
+        Buffer b = pool.acquire(0, 100);
+        REQUIRE(b.empty());
+        REQUIRE(b.capacity() >= 128);
+        REQUIRE(pool.acquire(0, 0).capacity() == 0);
+    }
+
+    SECTION("released buffers are reused")
+    {
+        Buffer b = pool.acquire(0, 1000);
+        b.resize(10);
+        const char* storage = b.data();
+        size_t      capacity = b.capacity();
+
+        pool.release(0, b);
+        REQUIRE(b.capacity() == 0);             // the pool took over the storage
+        REQUIRE(pool.bytes() == capacity);
+
+        Buffer c = pool.acquire(0, 1000);
+        REQUIRE(c.data() == storage);
+        REQUIRE(c.empty());
+        REQUIRE(pool.bytes() == 0);
+    }
+
+    SECTION("size buckets")
+    {
+        Buffer small = pool.acquire(0, 64);
+        Buffer large = pool.acquire(0, 4096);
+        const char* small_storage = small.data();
+        const char* large_storage = large.data();
+        pool.release(0, small);
+        pool.release(0, large);
+
+        // a request is served from its own class: the small buffer can't hold it, and the large one is too big
+        Buffer mid = pool.acquire(0, 1000);
+        REQUIRE(mid.data() != small_storage);
+        REQUIRE(mid.data() != large_storage);
+
+        REQUIRE(pool.acquire(0, 3000).data() == large_storage);
+        REQUIRE(pool.acquire(0, 40).data()   == small_storage);
+    }
+
+    SECTION("the same peer is preferred, then any other")
+    {
+        Buffer a = pool.acquire(1, 500);
+        Buffer b = pool.acquire(2, 500);
+        const char* a_storage = a.data();
+        const char* b_storage = b.data();
+        pool.release(1, a);
+        pool.release(2, b);
+
+        REQUIRE(pool.acquire(1, 500).data() == a_storage);
+        REQUIRE(pool.acquire(3, 500).data() == b_storage);
+    }
+
+    SECTION("buffers from a different resource are not reused")
+    {
+        diy::HugePageResource other;
+        Buffer a = pool.acquire(0, 500, &other);
+        const char* storage = a.data();
+        pool.release(0, a);
+
+        Buffer b = pool.acquire(0, 500);
+        REQUIRE(b.data() != storage);
+        REQUIRE(b.get_allocator().resource() == diy::MemoryResource::new_delete());
+
+        Buffer c = pool.acquire(0, 500, &other);
+        REQUIRE(c.data() == storage);
+    }
+
+    SECTION("trim drops what went unused for a whole period")
+    {
+        Buffer a = pool.acquire(0, 500);
+        size_t capacity = a.capacity();
+        pool.release(0, a);
+
+        pool.trim();                            // released in this period, kept
+        REQUIRE(pool.bytes() == capacity);
+        pool.trim();                            // unused since the previous call, dropped
+        REQUIRE(pool.bytes() == 0);
+        REQUIRE(pool.acquire(0, 500).capacity() >= 500);
+    }
+}
@@ -0,0 +1,63 @@
+#include <limits>
+#include <vector>
+
+#include <diy/mpi.hpp>
+
+#define CATCH_CONFIG_RUNNER
+#include "catch.hpp"
+
+MPI_Count   type_size(const diy::mpi::datatype& type)
+{
+    MPI_Count size;
+    MPI_Type_size_x(type.handle(), &size);
+    return size;
+}
+
+TEST_CASE("large_datatype spans the count", "[datatypes]")
+{
+    SECTION("counts past INT_MAX")
+    {
+        size_t  counts[] = { size_t(std::numeric_limits<int>::max()) + 1,
+                             size_t(5) << 30,                             // a multiple of the chunk
+                             (size_t(5) << 30) + 12345 };
+        for (size_t count : counts)
+        {
+            diy::mpi::datatype type = diy::mpi::large_datatype(count);
+            REQUIRE(type_size(type) == MPI_Count(count));
+
+            MPI_Count lb, extent;
+            MPI_Type_get_extent_x(type.handle(), &lb, &extent);
+            REQUIRE(lb == 0);
+            REQUIRE(extent == MPI_Count(count));
+        }
+    }
+
+    SECTION("chunks and remainder carry the right bytes")
+    {
+        // small chunks exercise the same layout as the 1GB ones, without the memory
+        diy::mpi::communicator  world;
+        size_t  chunk    = 4096;
+        size_t  counts[] = { 3*chunk, 3*chunk + 17, 5, chunk };
+        for (size_t count : counts)
+        {
+            std::vector<char> out(count), in(count, 0);
+            for (size_t i = 0; i < count; ++i)
+                out[i] = char(i * 7 + 1);
+
+            diy::mpi::datatype type = diy::mpi::large_datatype(count, chunk);
+            REQUIRE(type_size(type) == MPI_Count(count));
+
+            diy::mpi::request recv = world.irecv(world.rank(), 0, &in[0],  type);
+            diy::mpi::request send = world.isend(world.rank(), 0, &out[0], type);
+            send.wait();
+            recv.wait();
+            REQUIRE(in == out);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    diy::mpi::environment   env(argc, argv);
+    return Catch::Session().run(argc, argv);
+}
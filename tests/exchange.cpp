@@ -0,0 +1,309 @@
+#include <vector>
+#include <set>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <diy/mpi.hpp>
+#include <diy/master.hpp>
+#include <diy/assigner.hpp>
+#include <diy/serialization.hpp>
+
+#include "opts.h"
+
+#define CATCH_CONFIG_RUNNER
+#include "catch.hpp"
+
+// Blocks form a ring; in every round each block sends its neighbors a vector
+// whose length varies a lot from block to block (so that the per-block cost is
+// uneven), followed by an aligned array that the neighbors read in place,
+// and checks what it receives from them.
+
+struct Block
+{
+  int                   gid;
+  int                   round = 0;
+  int                   errors = 0;
+  int                   received = 0;
+  std::vector<int>      values;
+
+  static void*  create()                                            { return new Block; }
+  static void   destroy(void* b)                                    { delete static_cast<Block*>(b); }
+  static void   save(const void* b_, diy::BinaryBuffer& bb)
+  {
+    const Block* b = static_cast<const Block*>(b_);
+    diy::save(bb, b->gid);
+    diy::save(bb, b->round);
+    diy::save(bb, b->errors);
+    diy::save(bb, b->received);
+    diy::save(bb, b->values);
+  }
+  static void   load(void* b_, diy::BinaryBuffer& bb)
+  {
+    Block* b = static_cast<Block*>(b_);
+    diy::load(bb, b->gid);
+    diy::load(bb, b->round);
+    diy::load(bb, b->errors);
+    diy::load(bb, b->received);
+    diy::load(bb, b->values);
+  }
+};
+
+size_t  message_size(int gid)                                       { return (gid % 7 == 0) ? 20000 : gid % 5; }
+
+void    enqueue(Block* b, const diy::Master::ProxyWithLink& cp)
+{
+  b->values.assign(message_size(b->gid), b->gid * 1000 + b->round);
+  std::vector<double> halo(b->gid % 3 + 1, b->gid + .5);
+
+  diy::Link* l = cp.link();
+
+  // a queue reference stays valid while the other queues are created
+  diy::MemoryBuffer* last = l->size() ? &cp.outgoing(l->target(l->size() - 1)) : 0;
+
+  for (int i = 0; i < l->size(); ++i)
+  {
+    cp.enqueue(l->target(i), b->values);
+    cp.enqueue(l->target(i), std::accumulate(b->values.begin(), b->values.end(), 0L));
+    cp.enqueue(l->target(i), char(b->round));        // throw off the alignment
+    cp.enqueue_aligned(l->target(i), &halo[0], halo.size());
+  }
+
+  if (last && last != &cp.outgoing(l->target(l->size() - 1)))
+    ++b->errors;
+}
+
+void    dequeue(Block* b, const diy::Master::ProxyWithLink& cp)
+{
+  size_t alignment = std::max(cp.master()->queue_alignment(), alignof(double));
+
+  diy::Link* l = cp.link();
+  for (int i = 0; i < l->size(); ++i)
+  {
+    int nbr = l->target(i).gid;
+
+    std::vector<int> values;
+    long             sum;
+    char             round;
+    cp.dequeue(nbr, values);
+    cp.dequeue(nbr, sum);
+    cp.dequeue(nbr, round);
+
+    diy::Span<double> halo = cp.incoming_span<double>(nbr);
+    if (halo.size() != size_t(nbr % 3 + 1) || round != char(b->round))
+      ++b->errors;
+    if ((reinterpret_cast<const char*>(halo.data()) - cp.incoming(nbr).buffer.data()) % alignment != 0)
+      ++b->errors;
+    if (reinterpret_cast<std::uintptr_t>(halo.data()) % alignment != 0)     // the queue storage is aligned too
+      ++b->errors;
+    for (double x : halo)
+      if (x != nbr + .5)
+        ++b->errors;
+
+    if (values.size() != message_size(nbr))
+      ++b->errors;
+    for (size_t j = 0; j < values.size(); ++j)
+      if (values[j] != nbr * 1000 + b->round)
+        ++b->errors;
+    if (sum != std::accumulate(values.begin(), values.end(), 0L))
+      ++b->errors;
+    ++b->received;
+  }
+  ++b->round;
+}
+
+struct ExchangeFixture
+{
+  static int            nblocks;
+  static int            threads;
+  static int            mem_blocks;
+  static int            rounds;
+  static bool           stealing;
+  static bool           overlap;
+  static bool           aggregate;
+  static bool           blocking;
+  static std::string    resource;
+  static size_t         alignment;
+  static std::string    prefix;
+
+  diy::mpi::communicator world;
+};
+
+int         ExchangeFixture::nblocks    = 0;
+int         ExchangeFixture::threads    = 2;
+int         ExchangeFixture::mem_blocks = -1;
+int         ExchangeFixture::rounds     = 4;
+bool        ExchangeFixture::stealing   = false;
+bool        ExchangeFixture::overlap    = false;
+bool        ExchangeFixture::aggregate  = false;
+bool        ExchangeFixture::blocking   = false;
+std::string ExchangeFixture::resource   = "new";
+size_t      ExchangeFixture::alignment  = 0;
+std::string ExchangeFixture::prefix     = "./DIY.XXXXXX";
+
+TEST_CASE_METHOD(ExchangeFixture, "Neighbor exchange", "[exchange]")
+{
+  // the resources have to outlive the master
+  diy::ArenaResource            arena(1 << 16);         // small chunks, so that a round spans several
+  diy::HugePageResource         huge_pages(4096);       // small threshold, so that the test queues qualify
+  diy::mpi::alloc_mem_resource  alloc_mem;
+
+  diy::FileStorage          storage(prefix);
+  diy::Master               master(world, threads, mem_blocks,
+                                   &Block::create, &Block::destroy,
+                                   &storage, &Block::save, &Block::load);
+  if (stealing)
+    master.set_schedule(diy::Master::Schedule::work_stealing);
+  if (overlap)
+  {
+    // callbacks have to be deferred until exchange() for it to overlap them with communication
+    master.set_overlap(true);
+    master.set_immediate(false);
+  }
+  master.set_aggregate(aggregate);
+  master.set_blocking(blocking);
+  master.set_queue_alignment(alignment);
+
+  if (resource == "arena")
+    master.set_memory_resource(&arena);
+  else if (resource == "hugepage")
+    master.set_memory_resource(&huge_pages);
+  else if (resource == "mpi")
+    master.set_memory_resource(&alloc_mem);
+
+  diy::RoundRobinAssigner   assigner(world.size(), nblocks);
+
+  std::vector<int> gids;
+  assigner.local_gids(world.rank(), gids);
+  for (unsigned i = 0; i < gids.size(); ++i)
+  {
+    int gid = gids[i];
+
+    std::set<int> nbrs = { (gid + nblocks - 1) % nblocks, (gid + 1) % nblocks };
+    nbrs.erase(gid);
+
+    diy::Link* link = new diy::Link;
+    for (int nbr : nbrs)
+    {
+      diy::BlockID bid = { nbr, assigner.rank(nbr) };
+      link->add_neighbor(bid);
+    }
+
+    Block* b = new Block;
+    b->gid = gid;
+    master.add(gid, b, link);
+  }
+
+  for (int r = 0; r < rounds; ++r)
+  {
+    master.foreach(&enqueue);
+    master.exchange();
+    master.foreach(&dequeue);
+
+    // every block was processed by exactly one thread, which accounted for all of its time
+    const diy::Master::ThreadStatsVector& stats = master.thread_stats();
+    REQUIRE(stats.size() == size_t(mem_blocks == -1 ? threads : std::min(threads, mem_blocks)));
+    size_t blocks = 0;
+    for (auto& s : stats)
+    {
+      blocks += s.blocks;
+      REQUIRE(s.busy >= 0);
+      REQUIRE(s.idle >= 0);
+      REQUIRE(s.busy + s.idle == Approx(stats[0].busy + stats[0].idle).epsilon(.01));
+      if (!stealing)
+        REQUIRE(s.steals == 0);
+    }
+    REQUIRE(blocks == master.size());
+  }
+  master.set_immediate(true);
+
+  master.set_threads(1);        // catch.hpp isn't thread-safe
+  master.foreach([&](Block* b, const diy::Master::ProxyWithLink& cp)
+  {
+    CHECK(b->errors == 0);
+    CHECK(b->round == rounds);
+    CHECK(b->received == rounds * cp.link()->size());
+  });
+}
+
+TEST_CASE_METHOD(ExchangeFixture, "Work stealing evens out the load", "[exchange]")
+{
+  diy::Master               master(world, 2);
+  master.set_schedule(diy::Master::Schedule::work_stealing);
+
+  diy::RoundRobinAssigner   assigner(world.size(), 16 * world.size());
+  std::vector<int> gids;
+  assigner.local_gids(world.rank(), gids);
+  for (int gid : gids)
+  {
+    Block* b = new Block;
+    b->gid = gid;
+    master.add(gid, b, new diy::Link);
+  }
+
+  // the first block to be picked up takes much longer than the rest, so whichever thread
+  // runs out of its own blocks first has to take some from the other one
+  std::atomic<bool> slow_taken(false);
+  master.foreach([&slow_taken](Block* b, const diy::Master::ProxyWithLink&)
+  {
+    if (!slow_taken.exchange(true))
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ++b->round;
+  });
+
+  const diy::Master::ThreadStatsVector& stats = master.thread_stats();
+  REQUIRE(stats.size() == 2);
+  REQUIRE(stats[0].blocks + stats[1].blocks == master.size());
+  REQUIRE(stats[0].steals + stats[1].steals > 0);
+  for (auto& s : stats)
+  {
+    REQUIRE(s.busy >= 0);
+    REQUIRE(s.idle >= 0);
+  }
+  // one of the threads slept through the slow block
+  REQUIRE(std::max(stats[0].busy, stats[1].busy) >= .05);
+
+  master.set_threads(1);
+  master.foreach([](Block* b, const diy::Master::ProxyWithLink&) { CHECK(b->round == 1); });
+}
+
+int main(int argc, char* argv[])
+{
+  // the workers allocate the queues, which, with -R mpi, calls MPI_Alloc_mem from several threads
+  diy::mpi::environment     env(argc, argv, MPI_THREAD_MULTIPLE);
+  diy::mpi::communicator    world;
+
+  Catch::Session session;
+
+  ExchangeFixture::nblocks = 4 * world.size();
+
+  using namespace opts;
+  Options ops(argc, argv);
+  ops
+      >> Option('b', "blocks",  ExchangeFixture::nblocks,     "number of blocks")
+      >> Option('t', "thread",  ExchangeFixture::threads,     "number of threads")
+      >> Option('m', "memory",  ExchangeFixture::mem_blocks,  "number of blocks to keep in memory")
+      >> Option('r', "rounds",  ExchangeFixture::rounds,      "number of exchange rounds")
+      >> Option('R', "resource", ExchangeFixture::resource,   "memory resource for the queues: new, arena, hugepage, or mpi")
+      >> Option('A', "align",   ExchangeFixture::alignment,   "alignment of the arrays in the queues")
+      >> Option(     "prefix",  ExchangeFixture::prefix,      "prefix for external storage")
+      ;
+  ExchangeFixture::stealing  = ops >> Present('s', "steal",     "use the work-stealing scheduler");
+  ExchangeFixture::overlap   = ops >> Present('o', "overlap",   "overlap the callbacks with communication");
+  ExchangeFixture::aggregate = ops >> Present('a', "aggregate", "send one message per process");
+  ExchangeFixture::blocking  = ops >> Present('w', "wait",      "wait for the messages instead of polling");
+  if (ops >> Present('h', "help", "show help"))
+  {
+    if (world.rank() == 0)
+      std::cout << ops;
+    return 1;
+  }
+
+  if (ExchangeFixture::resource == "mpi" && env.provided() < MPI_THREAD_MULTIPLE)
+    ExchangeFixture::threads = 1;
+
+  return session.run();
+}
@@ -0,0 +1,110 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <map>
+#include <random>
+
+#include <diy/detail/flat-map.hpp>
+
+// checks every key in [0, max_key) against the reference
+void    check(const diy::detail::IndexMap& m, const std::map<int,int>& ref, int max_key)
+{
+    REQUIRE(m.size() == ref.size());
+    for (int k = 0; k < max_key; ++k)
+    {
+        std::map<int,int>::const_iterator it = ref.find(k);
+        REQUIRE(m.find(k) == (it == ref.end() ? -1 : it->second));
+    }
+}
+
+TEST_CASE("IndexMap insert, erase, reinsert", "[flat-map]")
+{
+    diy::detail::IndexMap   m;
+    std::map<int,int>       ref;
+
+    SECTION("keys with a common stride")
+    {
+        // the gids an assigner deals to one rank are spaced by the number of ranks
+        for (int i = 0; i < 100; ++i)
+        {
+            m.insert(i * 64, i);
+            ref[i * 64] = i;
+        }
+        check(m, ref, 6400);
+
+        // erase every other key; the probe chains through the erased slots must stay intact
+        for (int i = 0; i < 100; i += 2)
+        {
+            m.erase(i * 64);
+            ref.erase(i * 64);
+        }
+        check(m, ref, 6400);
+
+        for (int i = 0; i < 100; i += 2)
+        {
+            m.insert(i * 64, -i);
+            ref[i * 64] = -i;
+        }
+        check(m, ref, 6400);
+    }
+
+    SECTION("random operations")
+    {
+        std::mt19937                        gen(0);
+        std::uniform_int_distribution<int>  key(0, 255);
+        std::uniform_int_distribution<int>  op(0, 2);
+        for (int i = 0; i < 20000; ++i)
+        {
+            int k = key(gen);
+            if (op(gen) == 0)
+            {
+                m.erase(k);
+                ref.erase(k);
+            } else
+            {
+                m.insert(k, i);
+                ref[k] = i;
+            }
+            if (i % 1000 == 0)
+                check(m, ref, 256);
+        }
+        check(m, ref, 256);
+    }
+
+    SECTION("erasing a missing key and clearing")
+    {
+        m.insert(3, 1);
+        m.erase(4);
+        REQUIRE(m.size() == 1);
+        REQUIRE(m.find(3) == 1);
+
+        m.clear();
+        REQUIRE(m.size() == 0);
+        REQUIRE(m.find(3) == -1);
+        m.insert(3, 2);
+        REQUIRE(m.find(3) == 2);
+    }
+}
+
+TEST_CASE("FlatMap", "[flat-map]")
+{
+    diy::detail::FlatMap<int, int>  m;
+    m[5] = 50;
+    m[1] = 10;
+    m[3] = 30;
+    m[1] = 11;
+
+    REQUIRE(m.size() == 3);
+    int expected[] = { 1, 3, 5 };
+    int j = 0;
+    for (diy::detail::FlatMap<int, int>::iterator it = m.begin(); it != m.end(); ++it)
+        REQUIRE(it->first == expected[j++]);
+    REQUIRE(m.find(1)->second == 11);
+    REQUIRE(m.find(2) == m.end());
+    REQUIRE(m.count(3) == 1);
+
+    REQUIRE(m.erase(3) == 1);
+    REQUIRE(m.erase(3) == 0);
+    REQUIRE(m.size() == 2);
+    REQUIRE(m.lower_bound(2)->first == 5);
+}
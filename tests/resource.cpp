@@ -0,0 +1,94 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <diy/resource.hpp>
+
+// counts what goes through it, to check that everything allocated is given back
+struct CountingResource: public diy::MemoryResource
+{
+  void*             allocate(size_t bytes) override             { ++allocations; live += bytes; return ::operator new(bytes); }
+  void              deallocate(void* p, size_t bytes) override  { --allocations; live -= bytes; ::operator delete(p); }
+
+  int               allocations = 0;
+  size_t            live        = 0;
+};
+
+TEST_CASE("AlignedResource", "[resource]")
+{
+    CountingResource    upstream;
+    for (size_t alignment : { 32, 64, 4096 })
+    {
+        diy::AlignedResource aligned(alignment, &upstream);
+        REQUIRE(aligned.alignment() == alignment);
+
+        std::vector<std::pair<void*, size_t>> blocks;
+        for (size_t bytes : { 1, 7, 64, 1000, 100000 })
+        {
+            void* p = aligned.allocate(bytes);
+            REQUIRE(reinterpret_cast<std::uintptr_t>(p) % alignment == 0);
+            std::fill_n(static_cast<char*>(p), bytes, 'x');
+            blocks.emplace_back(p, bytes);
+        }
+        for (auto& b : blocks)
+            aligned.deallocate(b.first, b.second);
+
+        REQUIRE(upstream.allocations == 0);
+        REQUIRE(upstream.live == 0);
+    }
+
+    // asking for less than the fundamental alignment gets the fundamental alignment
+    diy::AlignedResource small(1, &upstream);
+    REQUIRE(small.alignment() == alignof(std::max_align_t));
+}
+
+TEST_CASE("ArenaResource", "[resource]")
+{
+    CountingResource    upstream;
+    {
+        diy::ArenaResource  arena(4096, &upstream);
+
+        // enough small allocations to span several chunks
+        std::vector<void*> blocks;
+        for (int i = 0; i < 200; ++i)
+        {
+            void* p = arena.allocate(40);
+            REQUIRE(reinterpret_cast<std::uintptr_t>(p) % alignof(std::max_align_t) == 0);
+            std::fill_n(static_cast<char*>(p), 40, 'x');
+            blocks.push_back(p);
+        }
+        size_t chunks = arena.chunks();
+        REQUIRE(chunks > 1);
+        REQUIRE(upstream.allocations == int(chunks));
+
+        // the chunks emptied in the first pass serve the second one
+        for (int round = 0; round < 3; ++round)
+        {
+            for (void* p : blocks)
+                arena.deallocate(p, 40);
+            blocks.clear();
+            REQUIRE(arena.chunks() <= 2);       // the current chunk and a spare
+
+            for (int i = 0; i < 200; ++i)
+                blocks.push_back(arena.allocate(40));
+            REQUIRE(arena.chunks() <= chunks + 1);  // the first allocations fill the rest of the current chunk
+            REQUIRE(upstream.allocations == int(arena.chunks()));
+        }
+
+        // large allocations bypass the chunks
+        void* large = arena.allocate(2048);
+        REQUIRE(upstream.allocations == int(arena.chunks()) + 1);
+        arena.deallocate(large, 2048);
+        REQUIRE(upstream.allocations == int(arena.chunks()));
+
+        for (void* p : blocks)
+            arena.deallocate(p, 40);
+    }
+
+    // once everything is deallocated, the arena gives all of its chunks back
+    REQUIRE(upstream.allocations == 0);
+    REQUIRE(upstream.live == 0);
+}
@@ -0,0 +1,14 @@
+#!/bin/bash
+set -e
+
+mpiexec=$1
+shift
+
+for p in 1 2 3; do
+  for b in 2 8 9 16; do
+      $mpiexec -np $p ./all-to-all-test -b $b -k 2 $@
+  done
+  for b in 4 16; do
+      $mpiexec -np $p ./all-to-all-test -b $b -k 4 $@
+  done
+done
@@ -0,0 +1,13 @@
+#!/bin/bash
+set -e
+
+mpiexec=$1
+shift
+
+for p in 1 2 3; do
+  for b in 1 3 32; do
+      $mpiexec -np $p ./exchange-test -b $b $@
+      $mpiexec -np $p ./exchange-test -b $b -t 3 -s $@
+      $mpiexec -np $p ./exchange-test -b $b -t 2 -m 2 -s $@
+  done
+done
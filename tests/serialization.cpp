@@ -0,0 +1,159 @@
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <vector>
+
+#include <diy/serialization.hpp>
+
+// A type with its own overloads of diy::save() and diy::load() for a BinaryBuffer (instead of a
+// Serialization specialization), which have to be picked for a MemoryBuffer too
+namespace user { struct Offset { int x; }; }
+namespace diy
+{
+  void  save(BinaryBuffer& bb, const user::Offset& o)   { int x = o.x + 100; bb.save_binary((const char*) &x, sizeof(x)); }
+  void  load(BinaryBuffer& bb, user::Offset& o)         { int x; bb.load_binary((char*) &x, sizeof(x)); o.x = x - 100; }
+}
+
+// Saves c between two sentinel bytes (so that padding in aligned mode is exercised),
+// loads it back, and checks that the whole buffer was consumed
+template<class C>
+C   round_trip(const C& c, size_t alignment)
+{
+    diy::MemoryBuffer bb;
+    bb.alignment = alignment;
+
+    char head = 'h', tail = 't';
+    diy::save(bb, head);
+    diy::save(bb, c);
+    diy::save(bb, tail);
+
+    bb.reset();
+    C    r;
+    char h, t;
+    diy::load(bb, h);
+    diy::load(bb, r);
+    diy::load(bb, t);
+
+    REQUIRE(h == head);
+    REQUIRE(t == tail);
+    REQUIRE(bb.position == bb.size());
+    return r;
+}
+
+TEST_CASE("Associative containers round-trip", "[serialization]")
+{
+    for (size_t alignment : { 0, 64 })
+    {
+        // trivially copyable elements
+        {
+            std::map<int, double>                   m  { {1, .5}, {-3, 2.}, {7, 0.} };
+            std::set<long>                          s  { 4, -1, 9 };
+            std::unordered_map<unsigned, float>     um { {1u, 1.f}, {2u, 4.f}, {3u, 9.f} };
+            std::unordered_set<short>               us { 1, 2, 3, 5, 8 };
+            std::set<bool>                          b  { true };
+
+            REQUIRE(round_trip(m,  alignment) == m);
+            REQUIRE(round_trip(s,  alignment) == s);
+            REQUIRE(round_trip(um, alignment) == um);
+            REQUIRE(round_trip(us, alignment) == us);
+            REQUIRE(round_trip(b,  alignment) == b);
+        }
+
+        // non-trivial elements
+        {
+            std::map<std::string, bool>             m  { {"x", true}, {"yy", false} };
+            std::set<std::string>                   s  { "a", "bc", "" };
+            std::unordered_map<int, std::string>    um { {1, "a"}, {5, "bcd"} };
+            std::map<int, std::vector<float>>       mv { {1, {1.f, 2.f}}, {2, {}} };
+
+            REQUIRE(round_trip(m,  alignment) == m);
+            REQUIRE(round_trip(s,  alignment) == s);
+            REQUIRE(round_trip(um, alignment) == um);
+            REQUIRE(round_trip(mv, alignment) == mv);
+        }
+
+        // nested and empty
+        {
+            std::map<int, std::map<int, double>>    n  { {1, { {2, 3.} }}, {4, {}} };
+            std::map<int, double>                   e;
+            std::unordered_set<int>                 ue;
+
+            REQUIRE(round_trip(n,  alignment) == n);
+            REQUIRE(round_trip(e,  alignment) == e);
+            REQUIRE(round_trip(ue, alignment) == ue);
+        }
+    }
+}
+
+TEST_CASE("Loading into a non-empty container", "[serialization]")
+{
+    diy::MemoryBuffer bb;
+
+    SECTION("std::map overwrites existing keys")
+    {
+        std::map<int, double> m { {1, 10.}, {2, 20.} };
+        diy::save(bb, m);
+        bb.reset();
+
+        std::map<int, double> r { {1, -1.}, {3, 30.} };
+        diy::load(bb, r);
+        REQUIRE(r.size() == 3);
+        REQUIRE(r[1] == 10.);
+        REQUIRE(r[2] == 20.);
+        REQUIRE(r[3] == 30.);
+    }
+
+    SECTION("std::unordered_map keeps existing keys")
+    {
+        std::unordered_map<int, double> m { {1, 10.}, {2, 20.} };
+        diy::save(bb, m);
+        bb.reset();
+
+        std::unordered_map<int, double> r { {1, -1.}, {3, 30.} };
+        diy::load(bb, r);
+        REQUIRE(r.size() == 3);
+        REQUIRE(r[1] == -1.);
+        REQUIRE(r[2] == 20.);
+        REQUIRE(r[3] == 30.);
+    }
+
+    SECTION("std::unordered_map with non-trivial values keeps existing keys")
+    {
+        std::unordered_map<int, std::string> m { {1, "a"}, {2, "b"} };
+        diy::save(bb, m);
+        bb.reset();
+
+        std::unordered_map<int, std::string> r { {1, "z"} };
+        diy::load(bb, r);
+        REQUIRE(r.size() == 2);
+        REQUIRE(r[1] == "z");
+        REQUIRE(r[2] == "b");
+    }
+}
+
+TEST_CASE("User overloads for BinaryBuffer take precedence", "[serialization]")
+{
+    diy::MemoryBuffer bb;
+    diy::save(bb, user::Offset { 5 });
+    diy::save(bb, std::vector<user::Offset>(3, user::Offset { 7 }));
+
+    bb.reset();
+    int x;
+    diy::load(bb, x);
+    REQUIRE(x == 105);          // saved by the user's overload
+
+    bb.reset();
+    user::Offset o;
+    diy::load(bb, o);
+    REQUIRE(o.x == 5);
+
+    std::vector<user::Offset> v;
+    diy::load(bb, v);
+    REQUIRE(v.size() == 3);
+    REQUIRE(v[2].x == 7);
+}
@@ -102,6 +102,7 @@ struct SwapReduceFixture
     static int          mem_blocks;
     static int          threads;
     static int          k;
+    static size_t       alignment;
     static std::string  prefix;
 
     static bool         verbose;
@@ -114,6 +115,7 @@ size_t      SwapReduceFixture::num_points  = 100;            // points per block
 int         SwapReduceFixture::mem_blocks  = -1;             // all blocks in memory
 int         SwapReduceFixture::threads     = 1;
 int         SwapReduceFixture::k           = 2;              // radix for k-ary reduction
+size_t      SwapReduceFixture::alignment   = 0;              // queue alignment
 std::string SwapReduceFixture::prefix      = "./DIY.XXXXXX"; // for saving block files out of core
 bool        SwapReduceFixture::verbose     = false;
 
@@ -155,6 +157,7 @@ TEST_CASE_METHOD(SwapReduceFixture, "point sorting", "[swap-reduce]")
                                      &storage,
                                      &Block::save,
                                      &Block::load);
+    master.set_queue_alignment(alignment);
     AddBlock                  create(master, num_points); // object for adding new blocks to master
 
     int   dim = DIM;
@@ -204,6 +207,7 @@ int main(int argc, char* argv[])
         >> Option('b', "blocks",  SwapReduceFixture::nblocks,        "number of blocks")
         >> Option('t', "thread",  SwapReduceFixture::threads,        "number of threads")
         >> Option('m', "memory",  SwapReduceFixture::mem_blocks,     "number of blocks to keep in memory")
+        >> Option('A', "align",   SwapReduceFixture::alignment,      "queue alignment")
         >> Option(     "prefix",  SwapReduceFixture::prefix,         "prefix for external storage")
         ;
     bool  verbose = ops >> Present('v', "verbose", "print the block contents");